@@ -0,0 +1,81 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef COMPRESSED_DEPTH_IMAGE_TRANSPORT_BITPACK_CODEC_H_
+#define COMPRESSED_DEPTH_IMAGE_TRANSPORT_BITPACK_CODEC_H_
+
+namespace compressed_depth_image_transport {
+
+// Lossless 16 bit depth codec laid out for SIMD. The image is split into
+// blocks of 128 pixels, seen as 16 rows of 8 lanes. Each block stores a 16
+// byte bitmap of non-zero pixels, one byte with the bit width of the block
+// and the zigzag coded differences to the pixel 8 positions earlier, bit
+// packed per lane. Zero pixels repeat their prediction, so they cost no bits.
+// Every step works on 8 lanes of uint16 at once and maps directly onto SSE2
+// or NEON registers; other targets use a portable fallback.
+class BitpackCodec {
+ public:
+  BitpackCodec();
+  // Worst case size of the output of CompressBitpack in bytes.
+  static int MaxCompressedSize(int numPixels);
+  // Compress input data into output. The size of output must be at least
+  // MaxCompressedSize(numPixels). Returns the number of bytes written.
+  int CompressBitpack(const unsigned short* input, unsigned char* output,
+                      int numPixels);
+  // Decompress inputSize bytes of input data into output. The size of output
+  // must be equal to numPixels. Returns false if the input is truncated or
+  // corrupt, leaving the rest of output undefined.
+  bool DecompressBitpack(const unsigned char* input, int inputSize,
+                         unsigned short* output, int numPixels);
+  // Incremental decompression: after BeginDecompressBitpack, each call to
+  // DecompressBitpackPart decodes the next numPixels pixels into output, and
+  // returns false once the input is exhausted or found corrupt.
+  void BeginDecompressBitpack(const unsigned char* input, int inputSize);
+  bool DecompressBitpackPart(unsigned short* output, int numPixels);
+
+ private:
+  BitpackCodec(const BitpackCodec&);
+  BitpackCodec& operator=(const BitpackCodec&);
+
+  // State of the incremental decompression
+  const unsigned char* pInput_;
+  const unsigned char* pInputEnd_;
+  unsigned short previous_[8];
+  unsigned short block_[128];
+  int blockPosition_;
+};
+
+}  // namespace compressed_depth_image_transport
+
+#endif  // COMPRESSED_DEPTH_IMAGE_TRANSPORT_BITPACK_CODEC_H_
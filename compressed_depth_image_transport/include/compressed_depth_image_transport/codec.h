@@ -39,19 +39,55 @@
 #include "sensor_msgs/Image.h"
 #include "sensor_msgs/image_encodings.h"
 
+#include "compressed_depth_image_transport/compression_common.h"
+
 // Encoding and decoding of compressed depth images.
 namespace compressed_depth_image_transport
 {
 
 // Returns a null pointer on bad input.
-sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::CompressedImage& compressed_image);
+// With decimation > 1, each decimation x decimation block is reduced to one
+// pixel, taking either the first valid pixel ("nearest_valid") or the closest
+// one ("min_depth"). Trailing rows and columns that do not fill a block are
+// dropped. rvl and bitpack streams are reduced while they are decoded; png,
+// rvl2d and float streams are decoded at full resolution and reduced
+// afterwards, so decimation saves no decoding work for them.
+// With dequantize = false, quantized 32FC1 streams are delivered as the raw
+// 16 bit values, with an encoding like "16UC1; quantizedDepth inverse A B"
+// (see makeQuantizedDepthEncoding). Use dequantizeDepthImage to get float
+// depth later on. This is not a valid sensor_msgs encoding and cv_bridge
+// throws on it: read the parameters with parseQuantizedDepthEncoding, then
+// set the encoding to 16UC1 before converting the image with cv_bridge.
+sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::CompressedImage& compressed_image,
+                                                   int decimation = 1,
+                                                   const std::string& decimation_mode = "nearest_valid",
+                                                   bool dequantize = true);
+
+// Image encoding of 16 bit quantized depth with the given parameters.
+std::string makeQuantizedDepthEncoding(const ConfigHeader& config);
+
+// Reads the quantization parameters back from an image encoding. Returns
+// false if the encoding is not a quantized depth encoding.
+bool parseQuantizedDepthEncoding(const std::string& encoding, ConfigHeader& config);
+
+// Converts numPixels quantized values to depth in meters, zero values become
+// NaN. Vectorized with SSE2 or NEON where available.
+void dequantizeDepth(const unsigned short* input, float* output, int numPixels, const ConfigHeader& config);
+
+// Converts a quantized depth image to 32FC1. Returns a null pointer on bad
+// input.
+sensor_msgs::Image::Ptr dequantizeDepthImage(const sensor_msgs::Image& quantized);
 
 // Compress a depth image. Returns a null pointer on bad input.
+// 32 bit depth is quantized to 16 bit either as inverse depth ("inverse",
+// tuned by depth_quantization) or as round(depth * depth_scale) ("linear").
 sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
     const sensor_msgs::Image& message,
     const std::string& compression_format,
     double depth_max,
     double depth_quantization,
-    int png_level);
+    int png_level,
+    const std::string& quantization = "inverse",
+    double depth_scale = 1000.0);
 
 }  // namespace compressed_depth_image_transport
@@ -34,6 +34,8 @@
 
 #include "image_transport/simple_subscriber_plugin.h"
 #include <sensor_msgs/CompressedImage.h>
+#include <dynamic_reconfigure/server.h>
+#include <compressed_depth_image_transport/CompressedDepthSubscriberConfig.h>
 
 namespace compressed_depth_image_transport {
 
@@ -47,9 +49,23 @@ public:
     return "compressedDepth";
   }
 
+  virtual void shutdown();
+
 protected:
+  // Overridden to set up reconfigure server
+  virtual void subscribeImpl(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size,
+                             const Callback& callback, const ros::VoidPtr& tracked_object,
+                             const image_transport::TransportHints& transport_hints);
+
   virtual void internalCallback(const sensor_msgs::CompressedImageConstPtr& message,
                                 const Callback& user_cb);
+
+  typedef compressed_depth_image_transport::CompressedDepthSubscriberConfig Config;
+  typedef dynamic_reconfigure::Server<Config> ReconfigureServer;
+  boost::shared_ptr<ReconfigureServer> reconfigure_server_;
+  Config config_;
+
+  void configCb(Config& config, uint32_t level);
 };
 
 } //namespace compressed_depth_image_transport
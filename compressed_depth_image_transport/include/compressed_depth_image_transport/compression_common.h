@@ -41,7 +41,7 @@ namespace compressed_depth_image_transport
 // Compression formats
 enum compressionFormat
 {
-  UNDEFINED = -1, INV_DEPTH
+  UNDEFINED = -1, INV_DEPTH, LINEAR_DEPTH
 };
 
 // Compression configuration
@@ -50,6 +50,8 @@ struct ConfigHeader
   // compression format
   compressionFormat format;
   // quantization parameters (used in depth image compression)
+  // INV_DEPTH: depth = depthParam[0] / (value - depthParam[1])
+  // LINEAR_DEPTH: depth = value / depthParam[0]
   float depthParam[2];
 };
 
@@ -0,0 +1,84 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef COMPRESSED_DEPTH_IMAGE_TRANSPORT_FLOAT_CODEC_H_
+#define COMPRESSED_DEPTH_IMAGE_TRANSPORT_FLOAT_CODEC_H_
+
+#include <stdint.h>
+
+namespace compressed_depth_image_transport {
+
+// Lossless codec for 32 bit floating point depth images. Like RVL, the image
+// is coded as alternating runs of invalid (NaN) and valid pixels. Each valid
+// pixel is coded as the difference between its IEEE 754 bit pattern and the
+// one of the previous valid pixel, using leading-zero suppression.
+// All NaN values are decoded as quiet NaN, every other value is bit exact.
+class FloatCodec {
+ public:
+  FloatCodec();
+  // Worst case size of the output of CompressFloat in bytes.
+  static int MaxCompressedSize(int numPixels);
+  // Compress input data into output. The size of output must be at least
+  // MaxCompressedSize(numPixels). Returns the number of bytes written.
+  int CompressFloat(const float* input, unsigned char* output, int numPixels);
+  // Decompress inputSize bytes of input data into output. The size of output
+  // must be equal to numPixels. Returns false if the input is truncated or
+  // corrupt, leaving the rest of output undefined.
+  bool DecompressFloat(const unsigned char* input, int inputSize,
+                       float* output, int numPixels);
+
+ private:
+  FloatCodec(const FloatCodec&);
+  FloatCodec& operator=(const FloatCodec&);
+
+  void WriteBits(uint32_t value, int count);
+  uint32_t ReadBits(int count);
+  void EncodeRun(uint32_t length);
+  uint32_t DecodeRun();
+  void EncodeValue(uint32_t value);
+  uint32_t DecodeValue();
+
+  unsigned char* pOutput_;
+  const unsigned char* pInput_;
+  const unsigned char* pInputEnd_;
+  bool inputError_;
+  uint64_t bits_;
+  int bitCount_;
+  uint32_t previous_;
+  int previousWidth_;
+};
+
+}  // namespace compressed_depth_image_transport
+
+#endif  // COMPRESSED_DEPTH_IMAGE_TRANSPORT_FLOAT_CODEC_H_
@@ -14,6 +14,21 @@ class RvlCodec {
   // equal to numPixels.
   void DecompressRVL(const unsigned char* input, unsigned short* output,
                      int numPixels);
+  // Same as CompressRVL, but non-zero pixels are predicted from their
+  // already coded neighbours in the row above and to the left (LOCO-I median
+  // edge detector) instead of only the previous non-zero pixel. The worst
+  // case output size is the same as for CompressRVL.
+  int CompressRVL2D(const unsigned short* input, unsigned char* output,
+                    int width, int height);
+  // Decompress data produced by CompressRVL2D. The size of output must be
+  // equal to width * height.
+  void DecompressRVL2D(const unsigned char* input, unsigned short* output,
+                       int width, int height);
+  // Incremental decompression of data produced by CompressRVL: after
+  // BeginDecompressRVL, each call to DecompressRVLPart decodes the next
+  // numPixels pixels of the image into output.
+  void BeginDecompressRVL(const unsigned char* input);
+  void DecompressRVLPart(unsigned short* output, int numPixels);
 
  private:
   RvlCodec(const RvlCodec&);
@@ -26,6 +41,9 @@ class RvlCodec {
   int *pBuffer_;
   int word_;
   int nibblesWritten_;
+  int zerosLeft_;
+  int nonzerosLeft_;
+  unsigned short previous_;
 };
 
 }  // namespace compressed_depth_image_transport
@@ -0,0 +1,354 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "compressed_depth_image_transport/bitpack_codec.h"
+
+#include <stdint.h>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace compressed_depth_image_transport {
+
+namespace {
+
+const int kLanes = 8;
+const int kRows = 16;
+const int kBlockSize = kLanes * kRows;
+const int kBlockHeaderSize = kRows + 1;  // bitmap and bit width
+
+// 8 lanes of uint16. Shift counts may be anything from 0 to 16.
+#if defined(__SSE2__)
+struct U16x8 {
+  __m128i v;
+  static U16x8 zero() { U16x8 r = {_mm_setzero_si128()}; return r; }
+  static U16x8 load(const void* p) { U16x8 r = {_mm_loadu_si128((const __m128i*)p)}; return r; }
+  void store(void* p) const { _mm_storeu_si128((__m128i*)p, v); }
+  static U16x8 set1(uint16_t x) { U16x8 r = {_mm_set1_epi16((short)x)}; return r; }
+  U16x8 operator+(U16x8 o) const { U16x8 r = {_mm_add_epi16(v, o.v)}; return r; }
+  U16x8 operator-(U16x8 o) const { U16x8 r = {_mm_sub_epi16(v, o.v)}; return r; }
+  U16x8 operator&(U16x8 o) const { U16x8 r = {_mm_and_si128(v, o.v)}; return r; }
+  U16x8 operator|(U16x8 o) const { U16x8 r = {_mm_or_si128(v, o.v)}; return r; }
+  U16x8 operator^(U16x8 o) const { U16x8 r = {_mm_xor_si128(v, o.v)}; return r; }
+  U16x8 operator<<(int n) const { U16x8 r = {_mm_sll_epi16(v, _mm_cvtsi32_si128(n))}; return r; }
+  U16x8 operator>>(int n) const { U16x8 r = {_mm_srl_epi16(v, _mm_cvtsi32_si128(n))}; return r; }
+  // All ones in lanes that are zero.
+  U16x8 isZero() const { U16x8 r = {_mm_cmpeq_epi16(v, _mm_setzero_si128())}; return r; }
+  // Per lane (mask ? a : b).
+  static U16x8 select(U16x8 mask, U16x8 a, U16x8 b)
+  {
+    U16x8 r = {_mm_or_si128(_mm_and_si128(mask.v, a.v), _mm_andnot_si128(mask.v, b.v))};
+    return r;
+  }
+  // Bit l is set if lane l is all ones.
+  int toBits() const { return _mm_movemask_epi8(_mm_packs_epi16(v, _mm_setzero_si128())); }
+  // Inverse of toBits.
+  static U16x8 fromBits(int bits)
+  {
+    const __m128i lanes = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    U16x8 r = {_mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short)bits), lanes), lanes)};
+    return r;
+  }
+  // Zigzag coding of the lanes as int16.
+  U16x8 zigzag() const { U16x8 r = {_mm_xor_si128(_mm_slli_epi16(v, 1), _mm_srai_epi16(v, 15))}; return r; }
+  U16x8 unzigzag() const
+  {
+    U16x8 r = {_mm_xor_si128(_mm_srli_epi16(v, 1),
+                             _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi16(1))))};
+    return r;
+  }
+  uint16_t reduceOr() const
+  {
+    __m128i x = _mm_or_si128(v, _mm_srli_si128(v, 8));
+    x = _mm_or_si128(x, _mm_srli_si128(x, 4));
+    x = _mm_or_si128(x, _mm_srli_si128(x, 2));
+    return (uint16_t)_mm_cvtsi128_si32(x);
+  }
+};
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+struct U16x8 {
+  uint16x8_t v;
+  static U16x8 zero() { U16x8 r = {vdupq_n_u16(0)}; return r; }
+  static U16x8 load(const void* p) { U16x8 r = {vld1q_u16((const uint16_t*)p)}; return r; }
+  void store(void* p) const { vst1q_u16((uint16_t*)p, v); }
+  static U16x8 set1(uint16_t x) { U16x8 r = {vdupq_n_u16(x)}; return r; }
+  U16x8 operator+(U16x8 o) const { U16x8 r = {vaddq_u16(v, o.v)}; return r; }
+  U16x8 operator-(U16x8 o) const { U16x8 r = {vsubq_u16(v, o.v)}; return r; }
+  U16x8 operator&(U16x8 o) const { U16x8 r = {vandq_u16(v, o.v)}; return r; }
+  U16x8 operator|(U16x8 o) const { U16x8 r = {vorrq_u16(v, o.v)}; return r; }
+  U16x8 operator^(U16x8 o) const { U16x8 r = {veorq_u16(v, o.v)}; return r; }
+  U16x8 operator<<(int n) const { U16x8 r = {vshlq_u16(v, vdupq_n_s16(n))}; return r; }
+  U16x8 operator>>(int n) const { U16x8 r = {vshlq_u16(v, vdupq_n_s16(-n))}; return r; }
+  U16x8 isZero() const { U16x8 r = {vceqq_u16(v, vdupq_n_u16(0))}; return r; }
+  static U16x8 select(U16x8 mask, U16x8 a, U16x8 b) { U16x8 r = {vbslq_u16(mask.v, a.v, b.v)}; return r; }
+  int toBits() const
+  {
+    const uint16_t lanes[kLanes] = {1, 2, 4, 8, 16, 32, 64, 128};
+    return vaddvq_u16(vandq_u16(v, vld1q_u16(lanes)));
+  }
+  static U16x8 fromBits(int bits)
+  {
+    const uint16_t lanes[kLanes] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint16x8_t l = vld1q_u16(lanes);
+    U16x8 r = {vceqq_u16(vandq_u16(vdupq_n_u16((uint16_t)bits), l), l)};
+    return r;
+  }
+  U16x8 zigzag() const
+  {
+    U16x8 r = {veorq_u16(vshlq_n_u16(v, 1), vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(v), 15)))};
+    return r;
+  }
+  U16x8 unzigzag() const
+  {
+    U16x8 r = {veorq_u16(vshrq_n_u16(v, 1),
+                         vreinterpretq_u16_s16(vnegq_s16(vreinterpretq_s16_u16(vandq_u16(v, vdupq_n_u16(1))))))};
+    return r;
+  }
+  uint16_t reduceOr() const
+  {
+    uint16_t lanes[kLanes];
+    vst1q_u16(lanes, v);
+    uint16_t r = 0;
+    for (int l = 0; l < kLanes; l++) r |= lanes[l];
+    return r;
+  }
+};
+#else
+struct U16x8 {
+  uint16_t v[kLanes];
+  static U16x8 zero() { return set1(0); }
+  static U16x8 load(const void* p) { U16x8 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+  void store(void* p) const { memcpy(p, v, sizeof(v)); }
+  static U16x8 set1(uint16_t x) { U16x8 r; for (int l = 0; l < kLanes; l++) r.v[l] = x; return r; }
+#define COMPRESSED_DEPTH_LANEWISE(expr) U16x8 r; for (int l = 0; l < kLanes; l++) r.v[l] = (uint16_t)(expr); return r;
+  U16x8 operator+(U16x8 o) const { COMPRESSED_DEPTH_LANEWISE(v[l] + o.v[l]) }
+  U16x8 operator-(U16x8 o) const { COMPRESSED_DEPTH_LANEWISE(v[l] - o.v[l]) }
+  U16x8 operator&(U16x8 o) const { COMPRESSED_DEPTH_LANEWISE(v[l] & o.v[l]) }
+  U16x8 operator|(U16x8 o) const { COMPRESSED_DEPTH_LANEWISE(v[l] | o.v[l]) }
+  U16x8 operator^(U16x8 o) const { COMPRESSED_DEPTH_LANEWISE(v[l] ^ o.v[l]) }
+  U16x8 operator<<(int n) const { COMPRESSED_DEPTH_LANEWISE(n < 16 ? v[l] << n : 0) }
+  U16x8 operator>>(int n) const { COMPRESSED_DEPTH_LANEWISE(n < 16 ? v[l] >> n : 0) }
+  U16x8 isZero() const { COMPRESSED_DEPTH_LANEWISE(v[l] ? 0 : 0xffff) }
+  static U16x8 select(U16x8 mask, U16x8 a, U16x8 b) { COMPRESSED_DEPTH_LANEWISE(mask.v[l] ? a.v[l] : b.v[l]) }
+  static U16x8 fromBits(int bits) { COMPRESSED_DEPTH_LANEWISE((bits >> l) & 1 ? 0xffff : 0) }
+  U16x8 zigzag() const { COMPRESSED_DEPTH_LANEWISE((v[l] << 1) ^ ((int16_t)v[l] >> 15)) }
+  U16x8 unzigzag() const { COMPRESSED_DEPTH_LANEWISE((v[l] >> 1) ^ -(v[l] & 1)) }
+#undef COMPRESSED_DEPTH_LANEWISE
+  int toBits() const
+  {
+    int bits = 0;
+    for (int l = 0; l < kLanes; l++) bits |= (v[l] ? 1 : 0) << l;
+    return bits;
+  }
+  uint16_t reduceOr() const
+  {
+    uint16_t r = 0;
+    for (int l = 0; l < kLanes; l++) r |= v[l];
+    return r;
+  }
+};
+#endif
+
+// Encodes one block of kBlockSize pixels and updates the per lane
+// predictions. Returns the number of bytes written.
+inline int EncodeBlock(const unsigned short* input, unsigned char* output, U16x8& previous)
+{
+  U16x8 residuals[kRows];
+  U16x8 any = U16x8::zero();
+  for (int j = 0; j < kRows; j++) {
+    U16x8 pixels = U16x8::load(input + j * kLanes);
+    U16x8 invalid = pixels.isZero();
+    output[j] = (unsigned char)~invalid.toBits();
+    // Invalid pixels repeat the prediction, so their residual is zero.
+    U16x8 filled = U16x8::select(invalid, previous, pixels);
+    residuals[j] = (filled - previous).zigzag();
+    any = any | residuals[j];
+    previous = filled;
+  }
+
+  int width = 0;
+  for (uint16_t bits = any.reduceOr(); bits; bits >>= 1) width++;
+  output[kRows] = (unsigned char)width;
+  unsigned char* packed = output + kBlockHeaderSize;
+  if (!width)
+    return kBlockHeaderSize;
+
+  // Pack the residuals of each lane into width words, least significant first.
+  U16x8 word = U16x8::zero();
+  int filled = 0;
+  for (int j = 0; j < kRows; j++) {
+    word = word | (residuals[j] << filled);
+    filled += width;
+    if (filled >= 16) {
+      word.store(packed);
+      packed += sizeof(U16x8);
+      filled -= 16;
+      word = filled ? residuals[j] >> (width - filled) : U16x8::zero();
+    }
+  }
+  return kBlockHeaderSize + width * (int)sizeof(U16x8);
+}
+
+// Inverse of EncodeBlock, reading at most inputSize bytes. Returns the number
+// of bytes read, or 0 if the block is truncated or its bit width is invalid.
+inline int DecodeBlock(const unsigned char* input, int inputSize, unsigned short* output,
+                       U16x8& previous)
+{
+  if (inputSize < kBlockHeaderSize)
+    return 0;
+  const int width = input[kRows];
+  if (width > 16 || inputSize < kBlockHeaderSize + width * (int)sizeof(U16x8))
+    return 0;
+  const unsigned char* packed = input + kBlockHeaderSize;
+  if (!width) {
+    // Constant block, only the bitmap matters.
+    for (int j = 0; j < kRows; j++)
+      (previous & U16x8::fromBits(input[j])).store(output + j * kLanes);
+    return kBlockHeaderSize;
+  }
+
+  const U16x8 mask = U16x8::set1((uint16_t)((1u << width) - 1));
+  U16x8 word = U16x8::zero();
+  int consumed = 16;
+  for (int j = 0; j < kRows; j++) {
+    if (consumed == 16) {
+      word = U16x8::load(packed);
+      packed += sizeof(U16x8);
+      consumed = 0;
+    }
+    U16x8 residual;
+    if (consumed + width <= 16) {
+      residual = (word >> consumed) & mask;
+      consumed += width;
+    } else {
+      U16x8 low = word >> consumed;
+      word = U16x8::load(packed);
+      packed += sizeof(U16x8);
+      residual = (low | (word << (16 - consumed))) & mask;
+      consumed += width - 16;
+    }
+    previous = previous + residual.unzigzag();
+    (previous & U16x8::fromBits(input[j])).store(output + j * kLanes);
+  }
+  return kBlockHeaderSize + width * (int)sizeof(U16x8);
+}
+
+}  // namespace
+
+BitpackCodec::BitpackCodec() {}
+
+void BitpackCodec::BeginDecompressBitpack(const unsigned char* input, int inputSize) {
+  pInput_ = input;
+  pInputEnd_ = input + inputSize;
+  memset(previous_, 0, sizeof(previous_));
+  blockPosition_ = kBlockSize;
+}
+
+bool BitpackCodec::DecompressBitpackPart(unsigned short* output,
+                                         int numPixels) {
+  while (numPixels) {
+    if (blockPosition_ == kBlockSize && numPixels >= kBlockSize) {
+      // Whole block, decode in place.
+      U16x8 previous = U16x8::load(previous_);
+      const int read = DecodeBlock(pInput_, int(pInputEnd_ - pInput_), output, previous);
+      if (!read) return false;
+      pInput_ += read;
+      previous.store(previous_);
+      output += kBlockSize;
+      numPixels -= kBlockSize;
+      continue;
+    }
+    if (blockPosition_ == kBlockSize) {
+      U16x8 previous = U16x8::load(previous_);
+      const int read = DecodeBlock(pInput_, int(pInputEnd_ - pInput_), block_, previous);
+      if (!read) return false;
+      pInput_ += read;
+      previous.store(previous_);
+      blockPosition_ = 0;
+    }
+    int count = kBlockSize - blockPosition_;
+    if (count > numPixels) count = numPixels;
+    memcpy(output, block_ + blockPosition_, count * sizeof(unsigned short));
+    output += count;
+    numPixels -= count;
+    blockPosition_ += count;
+  }
+  return true;
+}
+
+int BitpackCodec::MaxCompressedSize(int numPixels) {
+  int numBlocks = (numPixels + kBlockSize - 1) / kBlockSize;
+  return numBlocks * (kBlockHeaderSize + 16 * (int)sizeof(U16x8));
+}
+
+int BitpackCodec::CompressBitpack(const unsigned short* input,
+                                  unsigned char* output, int numPixels) {
+  U16x8 previous = U16x8::zero();
+  unsigned char* p = output;
+  int i = 0;
+  for (; i + kBlockSize <= numPixels; i += kBlockSize)
+    p += EncodeBlock(input + i, p, previous);
+  if (i < numPixels) {
+    // Pad the last block with invalid pixels.
+    unsigned short last[kBlockSize] = {0};
+    memcpy(last, input + i, (numPixels - i) * sizeof(unsigned short));
+    p += EncodeBlock(last, p, previous);
+  }
+  return int(p - output);  // num bytes
+}
+
+bool BitpackCodec::DecompressBitpack(const unsigned char* input, int inputSize,
+                                     unsigned short* output, int numPixels) {
+  U16x8 previous = U16x8::zero();
+  const unsigned char* p = input;
+  const unsigned char* end = input + inputSize;
+  int i = 0;
+  for (; i + kBlockSize <= numPixels; i += kBlockSize) {
+    const int read = DecodeBlock(p, int(end - p), output + i, previous);
+    if (!read) return false;
+    p += read;
+  }
+  if (i < numPixels) {
+    unsigned short last[kBlockSize];
+    if (!DecodeBlock(p, int(end - p), last, previous)) return false;
+    memcpy(output + i, last, (numPixels - i) * sizeof(unsigned short));
+  }
+  return true;
+}
+
+}  // namespace compressed_depth_image_transport
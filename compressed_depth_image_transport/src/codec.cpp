@@ -33,15 +33,26 @@
 *  POSSIBILITY OF SUCH DAMAGE.
 *********************************************************************/
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <limits>
 #include <string>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include <opencv2/highgui/highgui.hpp>
 
 #include "cv_bridge/cv_bridge.h"
+#include "compressed_depth_image_transport/bitpack_codec.h"
 #include "compressed_depth_image_transport/codec.h"
 #include "compressed_depth_image_transport/compression_common.h"
+#include "compressed_depth_image_transport/float_codec.h"
 #include "compressed_depth_image_transport/rvl_codec.h"
 #include "ros/ros.h"
 
@@ -62,8 +73,302 @@ using namespace cv;
 namespace compressed_depth_image_transport
 {
 
-sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::CompressedImage& message)
+// Formats handled by compressDepth16 and decompressDepth16
+static bool isDepth16Format(const std::string& compression_format)
+{
+  return compression_format == "rvl" || compression_format == "rvl2d" || compression_format == "bitpack";
+}
+
+// Compress a 16 bit single channel image with RVL ("rvl"), its 2D predictive
+// variant ("rvl2d") or the SIMD block codec ("bitpack"). The image size is
+// stored in front of the compressed stream.
+static void compressDepth16(const Mat& image, const std::string& compression_format,
+                            std::vector<uint8_t>& compressedImage)
+{
+  int numPixels = image.rows * image.cols;
+  // In the worst case, RVL compression results in ~1.5x larger data.
+  compressedImage.resize(std::max(3 * numPixels, BitpackCodec::MaxCompressedSize(numPixels)) + 12);
+  uint32_t cols = image.cols;
+  uint32_t rows = image.rows;
+  memcpy(&compressedImage[0], &cols, 4);
+  memcpy(&compressedImage[4], &rows, 4);
+  int compressedSize;
+  if (compression_format == "bitpack") {
+    BitpackCodec bitpack;
+    compressedSize = bitpack.CompressBitpack(image.ptr<unsigned short>(), &compressedImage[8], numPixels);
+  } else if (compression_format == "rvl2d") {
+    RvlCodec rvl;
+    compressedSize = rvl.CompressRVL2D(image.ptr<unsigned short>(), &compressedImage[8], cols, rows);
+  } else {
+    RvlCodec rvl;
+    compressedSize = rvl.CompressRVL(image.ptr<unsigned short>(), &compressedImage[8], numPixels);
+  }
+  compressedImage.resize(8 + compressedSize);
+}
+
+static inline bool isValidDepth(unsigned short depth)
+{
+  return depth != 0;
+}
+
+static inline bool isValidDepth(float depth)
+{
+  return !std::isnan(depth);
+}
+
+// Reduce each decimation x decimation block of the rows starting at stripe to
+// a single pixel of row. nearest_valid takes the first valid pixel of the
+// block in scan order, min_depth the closest one. For inverse depth the
+// closest pixel has the largest value.
+template <typename T>
+static void decimateRow(const T* stripe, size_t stride, int cols, int decimation,
+                        bool min_depth, bool closer_is_larger, T invalid, T* row)
+{
+  for (int x = 0; x < cols / decimation; x++)
+  {
+    T best = invalid;
+    bool found = false;
+    for (int dy = 0; dy < decimation && (min_depth || !found); dy++)
+    {
+      const T* p = stripe + dy * stride + x * decimation;
+      for (int dx = 0; dx < decimation; dx++)
+      {
+        if (!isValidDepth(p[dx]))
+          continue;
+        if (!found || (min_depth && (closer_is_larger ? p[dx] > best : p[dx] < best)))
+        {
+          best = p[dx];
+          found = true;
+          if (!min_depth)
+            break;
+        }
+      }
+    }
+    row[x] = best;
+  }
+}
+
+// Decimate a full resolution depth image.
+template <typename T>
+static Mat decimate(const Mat& image, int decimation, bool min_depth, bool closer_is_larger, T invalid)
+{
+  if (decimation <= 1 || image.empty())
+    return image;
+  Mat decimated(image.rows / decimation, image.cols / decimation, image.type());
+  for (int y = 0; y < decimated.rows; y++)
+  {
+    decimateRow(image.ptr<T>(y * decimation), image.step1(), image.cols, decimation,
+                min_depth, closer_is_larger, invalid, decimated.ptr<T>(y));
+  }
+  return decimated;
+}
+
+// Inverse of compressDepth16, optionally decimating the image. rvl and bitpack
+// are decoded in stripes of decimation rows, so the full resolution image is
+// never allocated. Returns an empty matrix on bad input.
+static Mat decompressDepth16(const std::vector<uint8_t>& imageData, const std::string& compression_format,
+                             int decimation = 1, bool min_depth = false, bool closer_is_larger = false)
+{
+  if (imageData.size() < 8)
+    return Mat();
+  const unsigned char *buffer = imageData.data();
+  uint32_t cols, rows;
+  memcpy(&cols, &buffer[0], 4);
+  memcpy(&rows, &buffer[4], 4);
+
+  if (decimation > 1 && (compression_format == "rvl" || compression_format == "bitpack"))
+  {
+    Mat decimated(rows / decimation, cols / decimation, CV_16UC1);
+    std::vector<unsigned short> stripe(decimation * cols);
+    RvlCodec rvl;
+    BitpackCodec bitpack;
+    if (compression_format == "bitpack")
+      bitpack.BeginDecompressBitpack(&buffer[8], imageData.size() - 8);
+    else
+      rvl.BeginDecompressRVL(&buffer[8]);
+    for (int y = 0; y < decimated.rows; y++)
+    {
+      if (compression_format == "bitpack")
+      {
+        if (!bitpack.DecompressBitpackPart(stripe.data(), stripe.size()))
+        {
+          ROS_ERROR("Truncated or corrupt bitpack depth image");
+          return Mat();
+        }
+      }
+      else
+        rvl.DecompressRVLPart(stripe.data(), stripe.size());
+      decimateRow<unsigned short>(stripe.data(), cols, cols, decimation, min_depth, closer_is_larger, 0,
+                                  decimated.ptr<unsigned short>(y));
+    }
+    return decimated;
+  }
+  else if (decimation > 1)
+  {
+    // rvl2d predicts from the previous full resolution row, so it is decoded
+    // whole and reduced afterwards.
+    return decimate<unsigned short>(decompressDepth16(imageData, compression_format), decimation,
+                                    min_depth, closer_is_larger, 0);
+  }
+
+  Mat decompressed(rows, cols, CV_16UC1);
+  if (compression_format == "bitpack") {
+    BitpackCodec bitpack;
+    if (!bitpack.DecompressBitpack(&buffer[8], imageData.size() - 8, decompressed.ptr<unsigned short>(),
+                                   cols * rows))
+    {
+      ROS_ERROR("Truncated or corrupt bitpack depth image");
+      return Mat();
+    }
+  } else if (compression_format == "rvl2d") {
+    RvlCodec rvl;
+    rvl.DecompressRVL2D(&buffer[8], decompressed.ptr<unsigned short>(), cols, rows);
+  } else {
+    RvlCodec rvl;
+    rvl.DecompressRVL(&buffer[8], decompressed.ptr<unsigned short>(), cols * rows);
+  }
+  return decompressed;
+}
+
+// Losslessly compress a 32 bit float image. The image size is stored in front
+// of the compressed stream.
+static void compressFloat(const Mat& image, std::vector<uint8_t>& compressedImage)
+{
+  int numPixels = image.rows * image.cols;
+  compressedImage.resize(FloatCodec::MaxCompressedSize(numPixels) + 8);
+  uint32_t cols = image.cols;
+  uint32_t rows = image.rows;
+  memcpy(&compressedImage[0], &cols, 4);
+  memcpy(&compressedImage[4], &rows, 4);
+  FloatCodec codec;
+  int compressedSize = codec.CompressFloat(image.ptr<float>(), &compressedImage[8], numPixels);
+  compressedImage.resize(8 + compressedSize);
+}
+
+// Inverse of compressFloat. Returns an empty matrix on bad input.
+static Mat decompressFloat(const std::vector<uint8_t>& imageData)
+{
+  if (imageData.size() < 8)
+    return Mat();
+  const unsigned char *buffer = imageData.data();
+  uint32_t cols, rows;
+  memcpy(&cols, &buffer[0], 4);
+  memcpy(&rows, &buffer[4], 4);
+  Mat decompressed(rows, cols, CV_32FC1);
+  FloatCodec codec;
+  if (!codec.DecompressFloat(&buffer[8], imageData.size() - 8, decompressed.ptr<float>(), cols * rows))
+  {
+    ROS_ERROR("Truncated or corrupt float depth image");
+    return Mat();
+  }
+  return decompressed;
+}
+
+std::string makeQuantizedDepthEncoding(const ConfigHeader& config)
+{
+  char encoding[128];
+  snprintf(encoding, sizeof(encoding), "%s; quantizedDepth %s %.9g %.9g", enc::TYPE_16UC1.c_str(),
+           config.format == LINEAR_DEPTH ? "linear" : "inverse", config.depthParam[0], config.depthParam[1]);
+  return encoding;
+}
+
+bool parseQuantizedDepthEncoding(const std::string& encoding, ConfigHeader& config)
+{
+  const std::string prefix = enc::TYPE_16UC1 + "; quantizedDepth ";
+  if (encoding.compare(0, prefix.size(), prefix) != 0)
+    return false;
+  char mode[16];
+  if (sscanf(encoding.c_str() + prefix.size(), "%15s %f %f", mode, &config.depthParam[0], &config.depthParam[1]) != 3)
+    return false;
+  if (std::string(mode) == "linear")
+    config.format = LINEAR_DEPTH;
+  else if (std::string(mode) == "inverse")
+    config.format = INV_DEPTH;
+  else
+    return false;
+  return true;
+}
+
+void dequantizeDepth(const unsigned short* input, float* output, int numPixels, const ConfigHeader& config)
+{
+  // Both modes are depth = a / (value - b) or value * a, zero is invalid.
+  const bool linear = config.format == LINEAR_DEPTH;
+  const float a = linear ? 1.0f / config.depthParam[0] : config.depthParam[0];
+  const float b = config.depthParam[1];
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vnan = _mm_set1_ps(nan);
+  for (; i + 8 <= numPixels; i += 8)
+  {
+    __m128i values = _mm_loadu_si128((const __m128i*)(input + i));
+    __m128i invalid = _mm_cmpeq_epi16(values, zero);
+    __m128i invalidParts[2] = {_mm_unpacklo_epi16(invalid, invalid), _mm_unpackhi_epi16(invalid, invalid)};
+    __m128 parts[2] = {_mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero)),
+                       _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero))};
+    for (int j = 0; j < 2; j++)
+    {
+      __m128 depth = linear ? _mm_mul_ps(parts[j], va) : _mm_div_ps(va, _mm_sub_ps(parts[j], vb));
+      __m128 mask = _mm_castsi128_ps(invalidParts[j]);
+      _mm_storeu_ps(output + i + 4 * j, _mm_or_ps(_mm_and_ps(mask, vnan), _mm_andnot_ps(mask, depth)));
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b), vnan = vdupq_n_f32(nan);
+  for (; i + 8 <= numPixels; i += 8)
+  {
+    uint16x8_t values = vld1q_u16(input + i);
+    uint16x8_t invalid = vceqq_u16(values, vdupq_n_u16(0));
+    uint32x4_t invalidParts[2] = {vmovl_u16(vget_low_u16(invalid)), vmovl_u16(vget_high_u16(invalid))};
+    float32x4_t parts[2] = {vcvtq_f32_u32(vmovl_u16(vget_low_u16(values))),
+                            vcvtq_f32_u32(vmovl_u16(vget_high_u16(values)))};
+    for (int j = 0; j < 2; j++)
+    {
+      float32x4_t depth = linear ? vmulq_f32(parts[j], va) : vdivq_f32(va, vsubq_f32(parts[j], vb));
+      vst1q_f32(output + i + 4 * j, vbslq_f32(vtstq_u32(invalidParts[j], invalidParts[j]), vnan, depth));
+    }
+  }
+#endif
+  for (; i < numPixels; i++)
+  {
+    if (!input[i])
+      output[i] = nan;
+    else
+      output[i] = linear ? (float)input[i] * a : a / ((float)input[i] - b);
+  }
+}
+
+sensor_msgs::Image::Ptr dequantizeDepthImage(const sensor_msgs::Image& quantized)
+{
+  ConfigHeader config;
+  if (!parseQuantizedDepthEncoding(quantized.encoding, config) || quantized.is_bigendian ||
+      quantized.step < quantized.width * sizeof(unsigned short) ||
+      quantized.data.size() < (size_t)quantized.step * quantized.height)
+    return sensor_msgs::Image::Ptr();
+
+  sensor_msgs::Image::Ptr depth(new sensor_msgs::Image);
+  depth->header = quantized.header;
+  depth->height = quantized.height;
+  depth->width = quantized.width;
+  depth->encoding = enc::TYPE_32FC1;
+  depth->is_bigendian = false;
+  depth->step = quantized.width * sizeof(float);
+  depth->data.resize(depth->step * depth->height);
+  for (uint32_t y = 0; y < quantized.height; y++)
+  {
+    dequantizeDepth(reinterpret_cast<const unsigned short*>(&quantized.data[y * quantized.step]),
+                    reinterpret_cast<float*>(&depth->data[y * depth->step]), quantized.width, config);
+  }
+  return depth;
+}
+
+sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::CompressedImage& message,
+                                                   int decimation, const std::string& decimation_mode,
+                                                   bool dequantize)
 {
+  const bool min_depth = decimation_mode == "min_depth";
+
   cv_bridge::CvImagePtr cv_ptr(new cv_bridge::CvImage);
 
   // Copy message header
@@ -78,8 +383,18 @@ sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::Compressed
     compression_format = "png";
   } else {
     std::string format = message.format.substr(split_pos);
+    // The codec of linear streams follows a "linear" token
+    const size_t linear_pos = format.find("compressedDepth linear ");
+    if (linear_pos != std::string::npos)
+      format.erase(linear_pos + 16, 7);
     if (format.find("compressedDepth png") != std::string::npos) {
       compression_format = "png";
+    } else if (format.find("compressedDepth bitpack") != std::string::npos) {
+      compression_format = "bitpack";
+    } else if (format.find("compressedDepth float") != std::string::npos) {
+      compression_format = "float";
+    } else if (format.find("compressedDepth rvl2d") != std::string::npos) {
+      compression_format = "rvl2d";
     } else if (format.find("compressedDepth rvl") != std::string::npos) {
       compression_format = "rvl";
     } else if (format.find("compressedDepth") != std::string::npos && format.find("compressedDepth ") == std::string::npos) {
@@ -103,15 +418,23 @@ sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::Compressed
     // Get compressed image data
     const std::vector<uint8_t> imageData(message.data.begin() + sizeof(compressionConfig), message.data.end());
 
-    // Depth map decoding
-    float depthQuantA, depthQuantB;
-
-    // Read quantization parameters
-    depthQuantA = compressionConfig.depthParam[0];
-    depthQuantB = compressionConfig.depthParam[1];
-
-    if (enc::bitDepth(image_encoding) == 32)
+    if ((enc::bitDepth(image_encoding) == 32) && (compression_format == "float"))
+    {
+      // Lossless float stream, no dequantization needed. The float codec has
+      // no incremental decoder, so decimation happens after a full decode.
+      cv_ptr->image = decimate<float>(decompressFloat(imageData), decimation, min_depth, false,
+                                      std::numeric_limits<float>::quiet_NaN());
+      if (!cv_ptr->image.empty())
+      {
+        // Publish message to user callback
+        return cv_ptr->toImageMsg();
+      }
+    }
+    else if (enc::bitDepth(image_encoding) == 32)
     {
+      // Inverse depth gets larger towards the sensor
+      const bool closer_is_larger = compressionConfig.format != LINEAR_DEPTH;
+
       cv::Mat decompressed;
       if (compression_format == "png") {
         try
@@ -124,14 +447,10 @@ sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::Compressed
           ROS_ERROR("%s", e.what());
           return sensor_msgs::Image::Ptr();
         }
-      } else if (compression_format == "rvl") {
-        const unsigned char *buffer = imageData.data();
-        uint32_t cols, rows;
-        memcpy(&cols, &buffer[0], 4);
-        memcpy(&rows, &buffer[4], 4);
-        decompressed = Mat(rows, cols, CV_16UC1);
-        RvlCodec rvl;
-        rvl.DecompressRVL(&buffer[8], decompressed.ptr<unsigned short>(), cols * rows);
+        if (decompressed.type() == CV_16UC1)
+          decompressed = decimate<unsigned short>(decompressed, decimation, min_depth, closer_is_larger, 0);
+      } else if (isDepth16Format(compression_format)) {
+        decompressed = decompressDepth16(imageData, compression_format, decimation, min_depth, closer_is_larger);
       } else {
         return sensor_msgs::Image::Ptr();
       }
@@ -141,27 +460,21 @@ sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::Compressed
 
       if ((rows > 0) && (cols > 0))
       {
-        cv_ptr->image = Mat(rows, cols, CV_32FC1);
-
-        // Depth conversion
-        MatIterator_<float> itDepthImg = cv_ptr->image.begin<float>(),
-                            itDepthImg_end = cv_ptr->image.end<float>();
-        MatConstIterator_<unsigned short> itInvDepthImg = decompressed.begin<unsigned short>(),
-                                          itInvDepthImg_end = decompressed.end<unsigned short>();
-
-        for (; (itDepthImg != itDepthImg_end) && (itInvDepthImg != itInvDepthImg_end); ++itDepthImg, ++itInvDepthImg)
+        if (!dequantize)
         {
-          // check for NaN & max depth
-          if (*itInvDepthImg)
-          {
-            *itDepthImg = depthQuantA / ((float)*itInvDepthImg - depthQuantB);
-          }
-          else
-          {
-            *itDepthImg = std::numeric_limits<float>::quiet_NaN();
-          }
+          // Deliver the quantized values, parameters go into the encoding
+          cv_ptr->image = decompressed;
+          cv_ptr->encoding = makeQuantizedDepthEncoding(compressionConfig);
+          return cv_ptr->toImageMsg();
         }
 
+        // Depth conversion
+        cv_ptr->image = Mat(rows, cols, CV_32FC1);
+        if (!decompressed.isContinuous())
+          decompressed = decompressed.clone();
+        dequantizeDepth(decompressed.ptr<unsigned short>(), cv_ptr->image.ptr<float>(), rows * cols,
+                        compressionConfig);
+
         // Publish message to user callback
         return cv_ptr->toImageMsg();
       }
@@ -179,14 +492,10 @@ sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::Compressed
           ROS_ERROR("%s", e.what());
           return sensor_msgs::Image::Ptr();
         }
-      } else if (compression_format == "rvl") {
-        const unsigned char *buffer = imageData.data();
-        uint32_t cols, rows;
-        memcpy(&cols, &buffer[0], 4);
-        memcpy(&rows, &buffer[4], 4);
-        cv_ptr->image = Mat(rows, cols, CV_16UC1);
-        RvlCodec rvl;
-        rvl.DecompressRVL(&buffer[8], cv_ptr->image.ptr<unsigned short>(), cols * rows);
+        if (cv_ptr->image.type() == CV_16UC1)
+          cv_ptr->image = decimate<unsigned short>(cv_ptr->image, decimation, min_depth, false, 0);
+      } else if (isDepth16Format(compression_format)) {
+        cv_ptr->image = decompressDepth16(imageData, compression_format, decimation, min_depth, false);
       } else {
         return sensor_msgs::Image::Ptr();
       }
@@ -207,7 +516,8 @@ sensor_msgs::Image::Ptr decodeCompressedDepthImage(const sensor_msgs::Compressed
 sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
     const sensor_msgs::Image& message,
     const std::string& compression_format,
-    double depth_max, double depth_quantization, int png_level)
+    double depth_max, double depth_quantization, int png_level,
+    const std::string& quantization, double depth_scale)
 {
 
   // Compressed image message
@@ -230,14 +540,45 @@ sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
   // Compressed image data
   std::vector<uint8_t> compressedImage;
 
-  // Update ros message format header
-  compressed->format += "; compressedDepth " + compression_format;
+  // The float codec only applies to 32 bit images, 16 bit depth is already
+  // coded losslessly by RVL.
+  std::string format = compression_format;
+  if ((format == "float") && (bitDepth != 32))
+    format = "rvl";
+
+  // Update ros message format header. Linear streams carry an extra token, as
+  // older decoders ignore ConfigHeader::format and would read them as inverse
+  // depth. They reject "compressedDepth linear ..." as an unsupported format.
+  const bool linear = (bitDepth == 32) && (format != "float") && (quantization == "linear");
+  compressed->format += std::string("; compressedDepth ") + (linear ? "linear " : "") + format;
 
   // Check input format
   params[0] = cv::IMWRITE_PNG_COMPRESSION;
   params[1] = png_level;
 
-  if ((bitDepth == 32) && (numChannels == 1))
+  if ((bitDepth == 32) && (numChannels == 1) && (format == "float"))
+  {
+    // OpenCV-ROS bridge
+    cv_bridge::CvImageConstPtr cv_ptr;
+    try
+    {
+      cv_ptr = cv_bridge::toCvShare(message, boost::shared_ptr<void const>());
+    }
+    catch (cv_bridge::Exception& e)
+    {
+      ROS_ERROR("%s", e.what());
+      return sensor_msgs::CompressedImage::Ptr();
+    }
+
+    // Lossless compression, neither quantization nor max depth filtering
+    const Mat depthImg = cv_ptr->image.isContinuous() ? cv_ptr->image : cv_ptr->image.clone();
+    if ((depthImg.rows > 0) && (depthImg.cols > 0))
+    {
+      compressionConfig.depthParam[0] = compressionConfig.depthParam[1] = 0.0f;
+      compressFloat(depthImg, compressedImage);
+    }
+  }
+  else if ((bitDepth == 32) && (numChannels == 1))
   {
     float depthZ0 = depth_quantization;
     float depthMax = depth_max;
@@ -260,39 +601,66 @@ sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
 
     if ((rows > 0) && (cols > 0))
     {
-      // Allocate matrix for inverse depth (disparity) coding
+      // Allocate matrix for inverse depth (disparity) or linear depth coding
       Mat invDepthImg(rows, cols, CV_16UC1);
 
-      // Inverse depth quantization parameters
-      float depthQuantA = depthZ0 * (depthZ0 + 1.0f);
-      float depthQuantB = 1.0f - depthQuantA / depthMax;
-
       // Matrix iterators
       MatConstIterator_<float> itDepthImg = depthImg.begin<float>(),
                                itDepthImg_end = depthImg.end<float>();
       MatIterator_<unsigned short> itInvDepthImg = invDepthImg.begin<unsigned short>(),
                                    itInvDepthImg_end = invDepthImg.end<unsigned short>();
 
-      // Quantization
-      for (; (itDepthImg != itDepthImg_end) && (itInvDepthImg != itInvDepthImg_end); ++itDepthImg, ++itInvDepthImg)
+      if (linear)
       {
-        // check for NaN & max depth
-        if (*itDepthImg < depthMax)
+        float depthScale = depth_scale;
+
+        // Linear quantization, depths beyond the 16 bit range are dropped
+        for (; (itDepthImg != itDepthImg_end) && (itInvDepthImg != itInvDepthImg_end); ++itDepthImg, ++itInvDepthImg)
         {
-          *itInvDepthImg = depthQuantA / *itDepthImg + depthQuantB;
+          // check for NaN & max depth
+          float scaled = *itDepthImg * depthScale + 0.5f;
+          if ((*itDepthImg < depthMax) && (scaled >= 0.0f) && (scaled < 65536.0f))
+          {
+            *itInvDepthImg = scaled;
+          }
+          else
+          {
+            *itInvDepthImg = 0;
+          }
         }
-        else
+
+        // Add coding parameters to header
+        compressionConfig.format = LINEAR_DEPTH;
+        compressionConfig.depthParam[0] = depthScale;
+        compressionConfig.depthParam[1] = 0.0f;
+      }
+      else
+      {
+        // Inverse depth quantization parameters
+        float depthQuantA = depthZ0 * (depthZ0 + 1.0f);
+        float depthQuantB = 1.0f - depthQuantA / depthMax;
+
+        // Quantization
+        for (; (itDepthImg != itDepthImg_end) && (itInvDepthImg != itInvDepthImg_end); ++itDepthImg, ++itInvDepthImg)
         {
-          *itInvDepthImg = 0;
+          // check for NaN & max depth
+          if (*itDepthImg < depthMax)
+          {
+            *itInvDepthImg = depthQuantA / *itDepthImg + depthQuantB;
+          }
+          else
+          {
+            *itInvDepthImg = 0;
+          }
         }
-      }
 
-      // Add coding parameters to header
-      compressionConfig.depthParam[0] = depthQuantA;
-      compressionConfig.depthParam[1] = depthQuantB;
+        // Add coding parameters to header
+        compressionConfig.depthParam[0] = depthQuantA;
+        compressionConfig.depthParam[1] = depthQuantB;
+      }
 
       // Compress quantized disparity image
-      if (compression_format == "png") {
+      if (format == "png") {
         try
         {
           if (cv::imencode(".png", invDepthImg, compressedImage, params))
@@ -312,17 +680,8 @@ sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
           ROS_ERROR("%s", e.msg.c_str());
           return sensor_msgs::CompressedImage::Ptr();
         }
-      } else if (compression_format == "rvl") {
-        int numPixels = invDepthImg.rows * invDepthImg.cols;
-        // In the worst case, RVL compression results in ~1.5x larger data.
-        compressedImage.resize(3 * numPixels + 12);
-        uint32_t cols = invDepthImg.cols;
-        uint32_t rows = invDepthImg.rows;
-        memcpy(&compressedImage[0], &cols, 4);
-        memcpy(&compressedImage[4], &rows, 4);
-        RvlCodec rvl;
-        int compressedSize = rvl.CompressRVL(invDepthImg.ptr<unsigned short>(), &compressedImage[8], numPixels);
-        compressedImage.resize(8 + compressedSize);
+      } else if (isDepth16Format(format)) {
+        compressDepth16(invDepthImg, format, compressedImage);
       }
     }
   }
@@ -361,7 +720,7 @@ sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
       }
 
       // Compress raw depth image
-      if (compression_format == "png") {
+      if (format == "png") {
         if (cv::imencode(".png", cv_ptr->image, compressedImage, params))
         {
           float cRatio = (float)(cv_ptr->image.rows * cv_ptr->image.cols * cv_ptr->image.elemSize())
@@ -373,17 +732,8 @@ sensor_msgs::CompressedImage::Ptr encodeCompressedDepthImage(
           ROS_ERROR("cv::imencode (png) failed on input image");
           return sensor_msgs::CompressedImage::Ptr();
         }
-      } else if (compression_format == "rvl") {
-        int numPixels = cv_ptr->image.rows * cv_ptr->image.cols;
-        // In the worst case, RVL compression results in ~1.5x larger data.
-        compressedImage.resize(3 * numPixels + 12);
-        uint32_t cols = cv_ptr->image.cols;
-        uint32_t rows = cv_ptr->image.rows;
-        memcpy(&compressedImage[0], &cols, 4);
-        memcpy(&compressedImage[4], &rows, 4);
-        RvlCodec rvl;
-        int compressedSize = rvl.CompressRVL(cv_ptr->image.ptr<unsigned short>(), &compressedImage[8], numPixels);
-        compressedImage.resize(8 + compressedSize);
+      } else if (isDepth16Format(format)) {
+        compressDepth16(cv_ptr->image, format, compressedImage);
       }
     }
   }
@@ -74,7 +74,8 @@ void CompressedDepthPublisher::configCb(Config& config, uint32_t level)
 void CompressedDepthPublisher::publish(const sensor_msgs::Image& message, const PublishFn& publish_fn) const
 {
   sensor_msgs::CompressedImage::Ptr compressed_image =
-      encodeCompressedDepthImage(message, config_.format, config_.depth_max, config_.depth_quantization, config_.png_level);
+      encodeCompressedDepthImage(message, config_.format, config_.depth_max, config_.depth_quantization, config_.png_level,
+                                 config_.quantization, config_.depth_scale);
 
   if (compressed_image)
   {
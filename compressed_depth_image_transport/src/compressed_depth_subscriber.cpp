@@ -33,6 +33,7 @@
 *********************************************************************/
 
 #include "compressed_depth_image_transport/compressed_depth_subscriber.h"
+#include <boost/make_shared.hpp>
 
 #include "compressed_depth_image_transport/codec.h"
 #include "compressed_depth_image_transport/compression_common.h"
@@ -40,10 +41,35 @@
 namespace compressed_depth_image_transport
 {
 
+void CompressedDepthSubscriber::subscribeImpl(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size,
+                                              const Callback& callback, const ros::VoidPtr& tracked_object,
+                                              const image_transport::TransportHints& transport_hints)
+{
+  typedef image_transport::SimpleSubscriberPlugin<sensor_msgs::CompressedImage> Base;
+  Base::subscribeImpl(nh, base_topic, queue_size, callback, tracked_object, transport_hints);
+
+  // Set up reconfigure server for this topic
+  reconfigure_server_ = boost::make_shared<ReconfigureServer>(this->nh());
+  ReconfigureServer::CallbackType f = boost::bind(&CompressedDepthSubscriber::configCb, this, _1, _2);
+  reconfigure_server_->setCallback(f);
+}
+
+void CompressedDepthSubscriber::configCb(Config& config, uint32_t level)
+{
+  config_ = config;
+}
+
+void CompressedDepthSubscriber::shutdown()
+{
+  reconfigure_server_.reset();
+  image_transport::SimpleSubscriberPlugin<sensor_msgs::CompressedImage>::shutdown();
+}
+
 void CompressedDepthSubscriber::internalCallback(const sensor_msgs::CompressedImageConstPtr& message,
                                             const Callback& user_cb)
 {
-  sensor_msgs::Image::Ptr image = decodeCompressedDepthImage(*message);
+  sensor_msgs::Image::Ptr image =
+      decodeCompressedDepthImage(*message, config_.decimation, config_.decimation_mode, config_.dequantize);
   if (image)
   {
     user_cb(image);
@@ -0,0 +1,198 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "compressed_depth_image_transport/float_codec.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace compressed_depth_image_transport {
+
+// Number of significant bits in value.
+static inline int BitWidth(uint32_t value) {
+  return value ? 32 - __builtin_clz(value) : 0;
+}
+
+FloatCodec::FloatCodec() {}
+
+int FloatCodec::MaxCompressedSize(int numPixels) {
+  // At most 39 bits per value plus up to 6 bits of run lengths per pixel.
+  return 6 * numPixels + 16;
+}
+
+void FloatCodec::WriteBits(uint32_t value, int count) {
+  if (!count) return;
+  bits_ = (bits_ << count) | (count < 32 ? value & ((1u << count) - 1) : value);
+  bitCount_ += count;
+  while (bitCount_ >= 8) {
+    bitCount_ -= 8;
+    *pOutput_++ = (unsigned char)(bits_ >> bitCount_);
+  }
+}
+
+uint32_t FloatCodec::ReadBits(int count) {
+  if (!count) return 0;
+  // Refill byte by byte so that we never read beyond the end of the stream.
+  // Past the end, zeros are read and the input is marked as bad.
+  while (bitCount_ < count) {
+    unsigned char byte = 0;
+    if (pInput_ != pInputEnd_)
+      byte = *pInput_++;
+    else
+      inputError_ = true;
+    bits_ = (bits_ << 8) | byte;
+    bitCount_ += 8;
+  }
+  bitCount_ -= count;
+  uint64_t value = bits_ >> bitCount_;
+  return count < 32 ? (uint32_t)value & ((1u << count) - 1) : (uint32_t)value;
+}
+
+// Run lengths are Elias gamma coded (length + 1).
+void FloatCodec::EncodeRun(uint32_t length) {
+  uint32_t value = length + 1;
+  int width = BitWidth(value);
+  WriteBits(0, width - 1);
+  WriteBits(value, width);
+}
+
+uint32_t FloatCodec::DecodeRun() {
+  int width = 1;
+  while (!ReadBits(1)) {
+    // length + 1 has at most 32 bits, a longer prefix is corrupt.
+    if (++width > 32) {
+      inputError_ = true;
+      return 0;
+    }
+  }
+  uint32_t value = 1;
+  if (width > 1) value = (1u << (width - 1)) | ReadBits(width - 1);
+  return value - 1;
+}
+
+// Residuals are zigzag coded differences of the bit patterns:
+//   '0'                       residual is zero
+//   '10' + previous width     residual fits in the previous width, which is
+//                             at most 2 bits too wide
+//   '11' + 5 bit width - 1 + width bits
+void FloatCodec::EncodeValue(uint32_t value) {
+  int32_t delta = (int32_t)(value - previous_);
+  uint32_t residual = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  previous_ = value;
+  if (!residual) {
+    WriteBits(0, 1);
+    return;
+  }
+  int width = BitWidth(residual);
+  if (width <= previousWidth_ && width + 2 >= previousWidth_) {
+    WriteBits(2, 2);
+    WriteBits(residual, previousWidth_);
+  } else {
+    WriteBits(3, 2);
+    WriteBits(width - 1, 5);
+    WriteBits(residual, width);
+    previousWidth_ = width;
+  }
+}
+
+uint32_t FloatCodec::DecodeValue() {
+  uint32_t residual = 0;
+  if (ReadBits(1)) {
+    if (ReadBits(1)) previousWidth_ = ReadBits(5) + 1;
+    residual = ReadBits(previousWidth_);
+  }
+  int32_t delta = (int32_t)(residual >> 1) ^ -(int32_t)(residual & 1);
+  previous_ += (uint32_t)delta;
+  return previous_;
+}
+
+int FloatCodec::CompressFloat(const float* input, unsigned char* output,
+                              int numPixels) {
+  pOutput_ = output;
+  bits_ = 0;
+  bitCount_ = 0;
+  previous_ = 0;
+  previousWidth_ = 32;
+  const float* end = input + numPixels;
+  while (input != end) {
+    uint32_t invalid = 0, valid = 0;
+    for (; (input != end) && std::isnan(*input); input++, invalid++)
+      ;
+    EncodeRun(invalid);  // number of NaNs
+    for (const float* p = input; (p != end) && !std::isnan(*p++); valid++)
+      ;
+    EncodeRun(valid);  // number of valid values
+    for (; valid; valid--) {
+      uint32_t value;
+      memcpy(&value, input++, sizeof(value));
+      EncodeValue(value);
+    }
+  }
+  if (bitCount_)  // last few bits
+    WriteBits(0, 8 - bitCount_);
+  return int(pOutput_ - output);  // num bytes
+}
+
+bool FloatCodec::DecompressFloat(const unsigned char* input, int inputSize,
+                                 float* output, int numPixels) {
+  pInput_ = input;
+  pInputEnd_ = input + inputSize;
+  inputError_ = false;
+  bits_ = 0;
+  bitCount_ = 0;
+  previous_ = 0;
+  previousWidth_ = 32;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  int numPixelsToDecode = numPixels;
+  while (numPixelsToDecode) {
+    uint32_t invalid = DecodeRun();  // number of NaNs
+    if (inputError_) return false;
+    if (invalid > (uint32_t)numPixelsToDecode) invalid = numPixelsToDecode;
+    numPixelsToDecode -= invalid;
+    for (; invalid; invalid--) *output++ = nan;
+    uint32_t valid = DecodeRun();  // number of valid values
+    if (inputError_) return false;
+    if (valid > (uint32_t)numPixelsToDecode) valid = numPixelsToDecode;
+    numPixelsToDecode -= valid;
+    for (; valid; valid--) {
+      uint32_t value = DecodeValue();
+      memcpy(output++, &value, sizeof(value));
+    }
+    if (inputError_) return false;
+  }
+  return true;
+}
+
+}  // namespace compressed_depth_image_transport
@@ -89,4 +89,105 @@ void RvlCodec::DecompressRVL(const unsigned char* input, unsigned short* output,
   }
 }
 
+void RvlCodec::BeginDecompressRVL(const unsigned char* input) {
+  buffer_ = pBuffer_ = const_cast<int*>(reinterpret_cast<const int*>(input));
+  nibblesWritten_ = 0;
+  zerosLeft_ = nonzerosLeft_ = 0;
+  previous_ = 0;
+}
+
+void RvlCodec::DecompressRVLPart(unsigned short* output, int numPixels) {
+  while (numPixels) {
+    if (!zerosLeft_ && !nonzerosLeft_) {
+      zerosLeft_ = DecodeVLE();     // number of zeros
+      nonzerosLeft_ = DecodeVLE();  // number of nonzeros
+    }
+    int zeros = zerosLeft_ < numPixels ? zerosLeft_ : numPixels;
+    zerosLeft_ -= zeros;
+    numPixels -= zeros;
+    for (; zeros; zeros--) *output++ = 0;
+    int nonzeros = nonzerosLeft_ < numPixels ? nonzerosLeft_ : numPixels;
+    nonzerosLeft_ -= nonzeros;
+    numPixels -= nonzeros;
+    for (; nonzeros; nonzeros--) {
+      int positive = DecodeVLE();  // nonzero value
+      int delta = (positive >> 1) ^ -(positive & 1);
+      previous_ += delta;
+      *output++ = previous_;
+    }
+  }
+}
+
+// Predicts the pixel at (x, y) from its causal neighbours. Zero pixels carry
+// no depth, so the median edge detector is only used when the left, upper and
+// upper-left pixels are all valid. Otherwise fall back to the upper pixel and
+// finally to the previous non-zero pixel, which is what plain RVL uses.
+static inline int Predict2D(const unsigned short* image, int x, int y,
+                            int width, unsigned short previous) {
+  if (!y) return previous;
+  const unsigned short* p = image + y * width + x;
+  int up = p[-width];
+  if (!up) return previous;
+  if (!x) return up;
+  int left = p[-1], upLeft = p[-width - 1];
+  if (!left || !upLeft) return up;
+  int lo = left < up ? left : up;
+  int hi = left < up ? up : left;
+  if (upLeft >= hi) return lo;
+  if (upLeft <= lo) return hi;
+  return left + up - upLeft;
+}
+
+int RvlCodec::CompressRVL2D(const unsigned short* input, unsigned char* output,
+                            int width, int height) {
+  buffer_ = pBuffer_ = (int*)output;
+  nibblesWritten_ = 0;
+  const int numPixels = width * height;
+  int i = 0;
+  unsigned short previous = 0;
+  while (i != numPixels) {
+    int zeros = 0, nonzeros = 0;
+    for (; (i != numPixels) && !input[i]; i++, zeros++)
+      ;
+    EncodeVLE(zeros);  // number of zeros
+    for (int j = i; (j != numPixels) && input[j++]; nonzeros++)
+      ;
+    EncodeVLE(nonzeros);  // number of nonzeros
+    int x = nonzeros ? i % width : 0, y = nonzeros ? i / width : 0;
+    for (int end = i + nonzeros; i != end; i++) {
+      unsigned short current = input[i];
+      int delta = current - Predict2D(input, x, y, width, previous);
+      int positive = (delta << 1) ^ (delta >> 31);
+      EncodeVLE(positive);  // nonzero value
+      previous = current;
+      if (++x == width) x = 0, y++;
+    }
+  }
+  if (nibblesWritten_)  // last few values
+    *pBuffer_++ = word_ << 4 * (8 - nibblesWritten_);
+  return int((unsigned char*)pBuffer_ - (unsigned char*)buffer_);  // num bytes
+}
+
+void RvlCodec::DecompressRVL2D(const unsigned char* input,
+                               unsigned short* output, int width,
+                               int height) {
+  buffer_ = pBuffer_ = const_cast<int*>(reinterpret_cast<const int*>(input));
+  nibblesWritten_ = 0;
+  unsigned short previous = 0;
+  const int numPixels = width * height;
+  int i = 0;
+  while (i != numPixels) {
+    int zeros = DecodeVLE();  // number of zeros
+    for (; zeros; zeros--) output[i++] = 0;
+    int nonzeros = DecodeVLE();  // number of nonzeros
+    int x = nonzeros ? i % width : 0, y = nonzeros ? i / width : 0;
+    for (; nonzeros; nonzeros--, i++) {
+      int positive = DecodeVLE();  // nonzero value
+      int delta = (positive >> 1) ^ -(positive & 1);
+      previous = output[i] = Predict2D(output, x, y, width, previous) + delta;
+      if (++x == width) x = 0, y++;
+    }
+  }
+}
+
 }  // namespace compressed_depth_image_transport
@@ -0,0 +1,160 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "compressed_depth_image_transport/bitpack_codec.h"
+#include "compressed_depth_image_transport/rvl_codec.h"
+#include "depth_frame.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using compressed_depth_image_transport::BitpackCodec;
+
+TEST(BitpackCodecTest, reciprocalTestEmpty) {
+  const int size = 1000000;
+  std::vector<unsigned short> original(size);
+  std::vector<unsigned char> compressed(BitpackCodec::MaxCompressedSize(size));
+  std::vector<unsigned short> decompressed(size);
+  BitpackCodec codec;
+
+  // Constant depth.
+  std::fill(original.begin(), original.end(), 42);
+  int compressedSize = codec.CompressBitpack(&original[0], &compressed[0], size);
+  EXPECT_LT(compressedSize, size / 5);
+  EXPECT_TRUE(codec.DecompressBitpack(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(std::equal(original.begin(), original.end(), decompressed.begin()));
+
+  // Totally invalid depth.
+  std::fill(original.begin(), original.end(), 0);
+  compressedSize = codec.CompressBitpack(&original[0], &compressed[0], size);
+  EXPECT_TRUE(codec.DecompressBitpack(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(std::equal(original.begin(), original.end(), decompressed.begin()));
+
+  // Empty depth.
+  EXPECT_EQ(codec.CompressBitpack(NULL, NULL, 0), 0);
+  EXPECT_TRUE(codec.DecompressBitpack(NULL, 0, NULL, 0));  // should not die.
+}
+
+TEST(BitpackCodecTest, reciprocalTestRandom) {
+  // Not a multiple of the block size.
+  const int size = 1000003;
+  std::vector<unsigned short> original(size);
+  std::vector<unsigned char> compressed(BitpackCodec::MaxCompressedSize(size));
+  std::vector<unsigned short> decompressed(size);
+  BitpackCodec codec;
+
+  // Runs of random length and value, with a different value range per run
+  // so that all bit widths are exercised.
+  srand(0);
+  for (int i = 0; i < size;) {
+    int length = std::min<int>(rand() % 300, size - i);
+    int range = 1 << (rand() % 17);
+    for (int j = 0; j < length; j++)
+      original[i + j] = rand() % 4 ? (rand() ^ (static_cast<unsigned>(rand()) << 8)) % range : 0;
+    i += length;
+  }
+
+  const int compressedSize = codec.CompressBitpack(&original[0], &compressed[0], size);
+  EXPECT_GT(compressedSize, 0);
+  EXPECT_LE(compressedSize, BitpackCodec::MaxCompressedSize(size));
+  EXPECT_TRUE(codec.DecompressBitpack(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(std::equal(original.begin(), original.end(), decompressed.begin()));
+
+  // Incremental decompression in parts of varying size.
+  std::fill(decompressed.begin(), decompressed.end(), 0);
+  codec.BeginDecompressBitpack(&compressed[0], compressedSize);
+  for (int i = 0; i < size;) {
+    int length = std::min<int>(rand() % 1000, size - i);
+    EXPECT_TRUE(codec.DecompressBitpackPart(&decompressed[i], length));
+    i += length;
+  }
+  EXPECT_TRUE(std::equal(original.begin(), original.end(), decompressed.begin()));
+}
+
+// A smooth frame with sensor noise and holes must compress better than raw
+// 16 bit and round trip exactly. Throughput is measured by codec_benchmark.
+TEST(BitpackCodecTest, depthFrame) {
+  const int width = 640, height = 480, size = width * height;
+  const std::vector<unsigned short> original = makeDepthFrame(width, height);
+  std::vector<unsigned char> compressed(BitpackCodec::MaxCompressedSize(size));
+  std::vector<unsigned short> decompressed(size);
+  BitpackCodec codec;
+
+  const int compressedSize = codec.CompressBitpack(&original[0], &compressed[0], size);
+  EXPECT_LT(compressedSize, size);
+  EXPECT_TRUE(codec.DecompressBitpack(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(std::equal(original.begin(), original.end(), decompressed.begin()));
+}
+
+TEST(BitpackCodecTest, truncatedAndCorruptInput) {
+  const int width = 64, height = 48, size = width * height;
+  const std::vector<unsigned short> original = makeDepthFrame(width, height);
+  std::vector<unsigned char> compressed(BitpackCodec::MaxCompressedSize(size));
+  std::vector<unsigned short> decompressed(size);
+  BitpackCodec codec;
+  const int compressedSize = codec.CompressBitpack(&original[0], &compressed[0], size);
+
+  // Every truncation is detected, by both decoders. The input is copied to a
+  // buffer of its own size, so that reading past its end would show up under
+  // AddressSanitizer.
+  for (int truncated = 0; truncated < compressedSize; truncated += 1 + truncated / 8) {
+    std::vector<unsigned char> input(compressed.begin(), compressed.begin() + truncated);
+    const unsigned char* p = input.empty() ? NULL : &input[0];
+    EXPECT_FALSE(codec.DecompressBitpack(p, truncated, &decompressed[0], size))
+        << truncated << " of " << compressedSize << " bytes";
+    codec.BeginDecompressBitpack(p, truncated);
+    bool ok = true;
+    for (int i = 0; i < size && ok; i += width)
+      ok = codec.DecompressBitpackPart(&decompressed[i], width);
+    EXPECT_FALSE(ok) << truncated << " of " << compressedSize << " bytes";
+  }
+
+  // A bit width over 16 is rejected.
+  std::vector<unsigned char> garbage(compressed.begin(), compressed.begin() + compressedSize);
+  garbage[16] = 17;
+  EXPECT_FALSE(codec.DecompressBitpack(&garbage[0], garbage.size(), &decompressed[0], size));
+
+  // Other garbage may or may not decode, but must stay within its buffers.
+  srand(0);
+  for (int i = 0; i < 100; i++) {
+    garbage.resize(1 + rand() % 1024);
+    for (size_t j = 0; j < garbage.size(); j++) garbage[j] = rand();
+    codec.DecompressBitpack(&garbage[0], garbage.size(), &decompressed[0], size);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,123 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// Reports compression ratio and throughput of the lossless 16 bit depth
+// codecs on a synthetic frame. Not run as part of the tests; timings are
+// only meaningful in an optimized build.
+#include "compressed_depth_image_transport/bitpack_codec.h"
+#include "compressed_depth_image_transport/rvl_codec.h"
+#include "depth_frame.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+using compressed_depth_image_transport::BitpackCodec;
+
+typedef std::chrono::steady_clock Clock;
+
+const int kWidth = 640, kHeight = 480, kSize = kWidth * kHeight;
+
+// Runs encode and decode each iterations times and prints the average.
+// Returns false if the decoded frame differs from the original.
+template <class Encode, class Decode>
+bool benchmark(const char* name, const std::vector<unsigned short>& original,
+               int iterations, Encode encode, Decode decode) {
+  std::vector<unsigned char> compressed(
+      std::max(3 * kSize + 4,
+               BitpackCodec::MaxCompressedSize(kSize)));
+  std::vector<unsigned short> decompressed(kSize);
+  int compressedSize = 0;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < iterations; i++)
+    compressedSize = encode(&original[0], &compressed[0]);
+  Clock::time_point middle = Clock::now();
+  for (int i = 0; i < iterations; i++)
+    decode(&compressed[0], &decompressed[0]);
+  Clock::time_point end = Clock::now();
+
+  const double encodeMs =
+      std::chrono::duration<double, std::milli>(middle - start).count() / iterations;
+  const double decodeMs =
+      std::chrono::duration<double, std::milli>(end - middle).count() / iterations;
+  printf("%-8s ratio 1:%.2f, encode %.2f ms, decode %.2f ms\n", name,
+         2.0 * kSize / compressedSize, encodeMs, decodeMs);
+  return std::equal(original.begin(), original.end(), decompressed.begin());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : 50;
+  if (iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  const std::vector<unsigned short> original = makeDepthFrame(kWidth, kHeight);
+  compressed_depth_image_transport::RvlCodec rvl;
+  BitpackCodec bitpack;
+  bool ok = true;
+
+  ok &= benchmark(
+      "rvl", original, iterations,
+      [&](const unsigned short* in, unsigned char* out) { return rvl.CompressRVL(in, out, kSize); },
+      [&](const unsigned char* in, unsigned short* out) { rvl.DecompressRVL(in, out, kSize); });
+  ok &= benchmark(
+      "rvl2d", original, iterations,
+      [&](const unsigned short* in, unsigned char* out) {
+        return rvl.CompressRVL2D(in, out, kWidth, kHeight);
+      },
+      [&](const unsigned char* in, unsigned short* out) {
+        rvl.DecompressRVL2D(in, out, kWidth, kHeight);
+      });
+  ok &= benchmark(
+      "bitpack", original, iterations,
+      [&](const unsigned short* in, unsigned char* out) {
+        return bitpack.CompressBitpack(in, out, kSize);
+      },
+      [&](const unsigned char* in, unsigned short* out) {
+        bitpack.DecompressBitpack(in, BitpackCodec::MaxCompressedSize(kSize), out, kSize);
+      });
+
+  if (!ok) {
+    fprintf(stderr, "round trip mismatch\n");
+    return 1;
+  }
+  return 0;
+}
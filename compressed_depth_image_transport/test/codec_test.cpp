@@ -0,0 +1,174 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "compressed_depth_image_transport/codec.h"
+#include "cv_bridge/cv_bridge.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace enc = sensor_msgs::image_encodings;
+using namespace compressed_depth_image_transport;
+
+// 32FC1 depth image of a slanted plane with a few invalid pixels.
+static sensor_msgs::Image makeDepthImage(int width, int height) {
+  sensor_msgs::Image image;
+  image.width = width;
+  image.height = height;
+  image.encoding = enc::TYPE_32FC1;
+  image.step = width * sizeof(float);
+  image.data.resize(image.step * height);
+  float* depth = reinterpret_cast<float*>(&image.data[0]);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      depth[y * width + x] =
+          (x + y) % 7 ? 0.5f + 0.01f * x + 0.005f * y : std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+  return image;
+}
+
+static void expectSameDepth(const sensor_msgs::Image& a, const sensor_msgs::Image& b) {
+  ASSERT_EQ(a.width, b.width);
+  ASSERT_EQ(a.height, b.height);
+  ASSERT_EQ(a.encoding, b.encoding);
+  ASSERT_EQ(a.data.size(), b.data.size());
+  const float* depthA = reinterpret_cast<const float*>(&a.data[0]);
+  const float* depthB = reinterpret_cast<const float*>(&b.data[0]);
+  for (size_t i = 0; i < a.width * a.height; i++) {
+    if (std::isnan(depthA[i]))
+      EXPECT_TRUE(std::isnan(depthB[i]));
+    else
+      EXPECT_EQ(depthA[i], depthB[i]);
+  }
+}
+
+TEST(CodecTest, deferredDequantization) {
+  const sensor_msgs::Image original = makeDepthImage(67, 31);
+  const char* quantizations[] = {"inverse", "linear"};
+  for (int q = 0; q < 2; q++) {
+    sensor_msgs::CompressedImage::Ptr compressed =
+        encodeCompressedDepthImage(original, "rvl", 10.0, 100.0, 1, quantizations[q], 1000.0);
+    ASSERT_TRUE(compressed);
+    EXPECT_EQ(compressed->format, q ? "32FC1; compressedDepth linear rvl" : "32FC1; compressedDepth rvl");
+
+    sensor_msgs::Image::Ptr depth = decodeCompressedDepthImage(*compressed);
+    sensor_msgs::Image::Ptr quantized = decodeCompressedDepthImage(*compressed, 1, "nearest_valid", false);
+    ASSERT_TRUE(depth);
+    ASSERT_TRUE(quantized);
+    EXPECT_EQ(depth->encoding, enc::TYPE_32FC1);
+    EXPECT_EQ(quantized->step, quantized->width * sizeof(unsigned short));
+
+    ConfigHeader config;
+    ASSERT_TRUE(parseQuantizedDepthEncoding(quantized->encoding, config));
+    EXPECT_EQ(config.format, q ? LINEAR_DEPTH : INV_DEPTH);
+
+    sensor_msgs::Image::Ptr dequantized = dequantizeDepthImage(*quantized);
+    ASSERT_TRUE(dequantized);
+    expectSameDepth(*depth, *dequantized);
+  }
+
+  EXPECT_FALSE(dequantizeDepthImage(original));
+}
+
+// The quantized encoding is not a sensor_msgs encoding. cv_bridge must
+// reject it rather than guess, and accept the image once the parameters have
+// been read and the encoding reset to 16UC1.
+TEST(CodecTest, quantizedEncodingWithCvBridge) {
+  const sensor_msgs::Image original = makeDepthImage(67, 31);
+  sensor_msgs::CompressedImage::Ptr compressed =
+      encodeCompressedDepthImage(original, "rvl", 10.0, 100.0, 1, "inverse", 1000.0);
+  ASSERT_TRUE(compressed);
+  sensor_msgs::Image::Ptr quantized = decodeCompressedDepthImage(*compressed, 1, "nearest_valid", false);
+  ASSERT_TRUE(quantized);
+
+  EXPECT_THROW(cv_bridge::toCvShare(quantized), cv_bridge::Exception);
+  EXPECT_THROW(cv_bridge::toCvCopy(*quantized, enc::TYPE_16UC1), cv_bridge::Exception);
+
+  ConfigHeader config;
+  ASSERT_TRUE(parseQuantizedDepthEncoding(quantized->encoding, config));
+  quantized->encoding = enc::TYPE_16UC1;
+  cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(quantized);
+  ASSERT_TRUE(cv_ptr);
+  EXPECT_EQ(cv_ptr->image.type(), CV_16UC1);
+  EXPECT_EQ(0, memcmp(cv_ptr->image.ptr(), &quantized->data[0], quantized->data.size()));
+}
+
+TEST(CodecTest, decimation) {
+  const sensor_msgs::Image original = makeDepthImage(64, 48);
+  const char* formats[] = {"rvl", "bitpack", "rvl2d", "float"};
+  for (int f = 0; f < 4; f++) {
+    sensor_msgs::CompressedImage::Ptr compressed =
+        encodeCompressedDepthImage(original, formats[f], 10.0, 100.0, 1, "linear", 1000.0);
+    ASSERT_TRUE(compressed);
+    sensor_msgs::Image::Ptr full = decodeCompressedDepthImage(*compressed);
+    ASSERT_TRUE(full);
+    const float* fullDepth = reinterpret_cast<const float*>(&full->data[0]);
+
+    for (int d = 2; d <= 4; d *= 2) {
+      sensor_msgs::Image::Ptr nearest = decodeCompressedDepthImage(*compressed, d, "nearest_valid");
+      sensor_msgs::Image::Ptr closest = decodeCompressedDepthImage(*compressed, d, "min_depth");
+      ASSERT_TRUE(nearest);
+      ASSERT_TRUE(closest);
+      ASSERT_EQ(nearest->width, full->width / d);
+      ASSERT_EQ(nearest->height, full->height / d);
+      const float* nearestDepth = reinterpret_cast<const float*>(&nearest->data[0]);
+      const float* closestDepth = reinterpret_cast<const float*>(&closest->data[0]);
+
+      for (uint32_t y = 0; y < nearest->height; y++) {
+        for (uint32_t x = 0; x < nearest->width; x++) {
+          float first = std::numeric_limits<float>::quiet_NaN(), min = first;
+          for (int dy = 0; dy < d; dy++) {
+            for (int dx = 0; dx < d; dx++) {
+              float value = fullDepth[(y * d + dy) * full->width + x * d + dx];
+              if (std::isnan(value)) continue;
+              if (std::isnan(first)) first = value;
+              if (std::isnan(min) || value < min) min = value;
+            }
+          }
+          const size_t i = y * nearest->width + x;
+          EXPECT_TRUE(first == nearestDepth[i] || (std::isnan(first) && std::isnan(nearestDepth[i])));
+          EXPECT_TRUE(min == closestDepth[i] || (std::isnan(min) && std::isnan(closestDepth[i])));
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,66 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef COMPRESSED_DEPTH_IMAGE_TRANSPORT_TEST_DEPTH_FRAME_H_
+#define COMPRESSED_DEPTH_IMAGE_TRANSPORT_TEST_DEPTH_FRAME_H_
+
+#include <cstdlib>
+#include <vector>
+
+// Synthetic 16 bit depth frame (millimetres) resembling a ToF/structured
+// light sensor looking at a floor, a wall and a box: smooth slanted planes,
+// +-1 mm sensor noise and a few invalid (zero) patches and edge pixels.
+inline std::vector<unsigned short> makeDepthFrame(int width, int height) {
+  std::vector<unsigned short> depth(width * height);
+  srand(0);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      double z;
+      if (y > height / 2) {
+        z = 400000.0 / (y - height / 2 + 80);  // floor
+      } else {
+        z = 4000.0 + 2.0 * x;  // slanted wall
+      }
+      if (x > width / 3 && x < width / 2 && y > height / 4 && y < 3 * height / 4)
+        z = 1500.0 + 0.5 * (x - width / 3) + 0.25 * y;  // box
+      z += rand() % 3 - 1;
+      const bool hole = (x > 3 * width / 4 && y < height / 5) || rand() % 50 == 0 ||
+                        x == width / 3 + 1;  // shadow at the box edge
+      depth[y * width + x] = hole ? 0 : static_cast<unsigned short>(z);
+    }
+  }
+  return depth;
+}
+
+#endif  // COMPRESSED_DEPTH_IMAGE_TRANSPORT_TEST_DEPTH_FRAME_H_
@@ -0,0 +1,167 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "compressed_depth_image_transport/float_codec.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using compressed_depth_image_transport::FloatCodec;
+
+// Bitwise comparison, treating all NaNs as equal.
+static bool sameDepth(const std::vector<float>& a, const std::vector<float>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (std::isnan(a[i]) && std::isnan(b[i])) continue;
+    if (memcmp(&a[i], &b[i], sizeof(float))) return false;
+  }
+  return true;
+}
+
+TEST(FloatCodecTest, reciprocalTestConstant) {
+  const int size = 1000000;
+  std::vector<float> original(size);
+  std::vector<unsigned char> compressed(FloatCodec::MaxCompressedSize(size));
+  std::vector<float> decompressed(size);
+  FloatCodec codec;
+
+  // Constant depth.
+  std::fill(original.begin(), original.end(), 1.234f);
+  int compressedSize = codec.CompressFloat(&original[0], &compressed[0], size);
+  EXPECT_LT(compressedSize, size / 4);
+  EXPECT_TRUE(codec.DecompressFloat(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(sameDepth(original, decompressed));
+
+  // Totally invalid depth.
+  std::fill(original.begin(), original.end(), std::numeric_limits<float>::quiet_NaN());
+  compressedSize = codec.CompressFloat(&original[0], &compressed[0], size);
+  EXPECT_LT(compressedSize, 16);
+  EXPECT_TRUE(codec.DecompressFloat(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(sameDepth(original, decompressed));
+
+  // Empty depth.
+  EXPECT_EQ(codec.CompressFloat(NULL, NULL, 0), 0);
+  EXPECT_TRUE(codec.DecompressFloat(NULL, 0, NULL, 0));  // should not die.
+}
+
+TEST(FloatCodecTest, reciprocalTestRandom) {
+  const int size = 1000000;
+  std::vector<float> original(size);
+  std::vector<unsigned char> compressed(FloatCodec::MaxCompressedSize(size));
+  std::vector<float> decompressed(size);
+  FloatCodec codec;
+
+  // Random bit patterns, including infinities, denormals and negative zero,
+  // interleaved with NaN runs.
+  srand(0);
+  for (int i = 0; i < size; i++) {
+    if (rand() % 4 == 0) {
+      original[i] = std::numeric_limits<float>::quiet_NaN();
+    } else {
+      uint32_t bits = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+      memcpy(&original[i], &bits, sizeof(bits));
+    }
+  }
+  original[0] = std::numeric_limits<float>::infinity();
+  original[1] = -0.0f;
+  original[2] = std::numeric_limits<float>::denorm_min();
+
+  const int compressedSize = codec.CompressFloat(&original[0], &compressed[0], size);
+  EXPECT_GT(compressedSize, 0);
+  EXPECT_LE(compressedSize, FloatCodec::MaxCompressedSize(size));
+  EXPECT_TRUE(codec.DecompressFloat(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(sameDepth(original, decompressed));
+}
+
+TEST(FloatCodecTest, reciprocalTestDepth) {
+  const int width = 640, height = 480, size = width * height;
+  std::vector<float> original(size);
+  std::vector<unsigned char> compressed(FloatCodec::MaxCompressedSize(size));
+  std::vector<float> decompressed(size);
+  FloatCodec codec;
+
+  // Slanted plane in metres, converted from millimetres, with invalid holes.
+  srand(0);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int mm = 1000 + 2 * x + y + rand() % 3;
+      original[y * width + x] =
+          rand() % 10 ? mm * 0.001f : std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+
+  const int compressedSize = codec.CompressFloat(&original[0], &compressed[0], size);
+  EXPECT_LT(compressedSize, size * 4 * 2 / 3);
+  EXPECT_TRUE(codec.DecompressFloat(&compressed[0], compressedSize, &decompressed[0], size));
+  EXPECT_TRUE(sameDepth(original, decompressed));
+}
+
+TEST(FloatCodecTest, truncatedAndCorruptInput) {
+  const int size = 10000;
+  std::vector<float> original(size);
+  std::vector<unsigned char> compressed(FloatCodec::MaxCompressedSize(size));
+  std::vector<float> decompressed(size);
+  FloatCodec codec;
+
+  srand(0);
+  for (int i = 0; i < size; i++)
+    original[i] = rand() % 10 ? (1000 + rand() % 100) * 0.001f : std::numeric_limits<float>::quiet_NaN();
+  const int compressedSize = codec.CompressFloat(&original[0], &compressed[0], size);
+
+  // Every truncation is detected. The input is copied to a buffer of its own
+  // size, so that reading past its end would show up under AddressSanitizer.
+  for (int truncated = 0; truncated < compressedSize; truncated += 1 + truncated / 8) {
+    std::vector<unsigned char> input(compressed.begin(), compressed.begin() + truncated);
+    EXPECT_FALSE(codec.DecompressFloat(input.empty() ? NULL : &input[0], truncated, &decompressed[0], size))
+        << truncated << " of " << compressedSize << " bytes";
+  }
+
+  // Garbage may or may not decode, but must stay within its buffers. Zeros
+  // make an endless run length prefix.
+  std::vector<unsigned char> garbage(64, 0);
+  EXPECT_FALSE(codec.DecompressFloat(&garbage[0], garbage.size(), &decompressed[0], size));
+  for (int i = 0; i < 100; i++) {
+    garbage.resize(1 + rand() % 256);
+    for (size_t j = 0; j < garbage.size(); j++) garbage[j] = rand();
+    codec.DecompressFloat(&garbage[0], garbage.size(), &decompressed[0], size);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef THEORA_IMAGE_TRANSPORT_COLOR_CONVERSION_H
+#define THEORA_IMAGE_TRANSPORT_COLOR_CONVERSION_H
+
+#include <cstddef>
+#include <string>
+
+#include <theora/codec.h>
+
+// Single pass conversions between packed 8 bit images and Theora's planar
+// Y'CbCr layout, vectorized with SSE2 or NEON where available. They use the
+// full range BT.601 coefficients of OpenCV's COLOR_BGR2YCrCb and
+// COLOR_YCrCb2BGR in low precision fixed point, so results may differ from
+// OpenCV by one.
+namespace theora_image_transport {
+
+// Channel layout of a packed 8 bit image.
+struct PackedFormat
+{
+  int channels; // 1 (mono), 3 or 4
+  int r, g, b;  // Channel index of each color, unused for mono
+};
+
+// Returns false if the encoding is not a packed 8 bit format handled below
+// (mono8, bgr8, rgb8, bgra8, rgba8).
+bool packedFormatFromEncoding(const std::string& encoding, PackedFormat& format);
+
+// Converts the width x height image at src to 4:2:0 or 4:2:2 Y'CbCr, writing
+// into the top left corner of the planes, which must cover the image rounded up
+// to even dimensions. Chroma is the average of each 2x2 block (2x1 for 4:2:2);
+// odd edges are replicated. Mono images only copy the luma plane and leave the
+// chroma planes alone, so callers can keep them at a constant 128.
+void packedToYCbCr(const unsigned char* src, int src_step, int width, int height,
+                   const PackedFormat& format, th_pixel_fmt pixel_fmt, th_ycbcr_buffer planes);
+
+// Layout of an 8 bit Y'CbCr image.
+struct YuvFormat
+{
+  enum Layout
+  {
+    PACKED_422,      // Macro pixels of 4 bytes holding two luma samples
+    SEMI_PLANAR_420, // Luma plane followed by interleaved chroma pairs
+    PLANAR_420       // Luma plane followed by two quarter size chroma planes
+  };
+  Layout layout;
+  int y;       // Byte offset of the first luma sample in a macro pixel, the second is at y + 2
+  int cb, cr;  // Byte offset in a macro pixel or chroma pair, or plane index (1 or 2) when planar
+};
+
+// Returns false if the encoding is not a Y'CbCr layout handled below
+// (yuv422/uyvy, yuv422_yuy2/yuyv, nv12, nv21, i420, yv12).
+bool yuvFormatFromEncoding(const std::string& encoding, YuvFormat& format);
+
+// Returns the number of bytes a width x height image with the given row step
+// takes in this format, or 0 if the step is too small. Chroma planes of planar
+// images are assumed to have a step of (step + 1) / 2.
+size_t yuvImageSize(const YuvFormat& format, int width, int height, int step);
+
+// Copies a Y'CbCr image into the planes in the given pixel format, averaging
+// or replicating chroma rows as needed. The values are passed through as is,
+// without any range conversion. Like packedToYCbCr, writes may extend to even
+// dimensions.
+void yuvToYCbCr(const unsigned char* src, int src_step, int width, int height,
+                const YuvFormat& format, th_pixel_fmt pixel_fmt, th_ycbcr_buffer planes);
+
+// Converts the width x height picture at (pic_x, pic_y) of a decoded frame in the given
+// pixel format to a packed image at dst. Chroma is upsampled by replication. Mono output
+// copies the luma plane.
+void yCbCrToPacked(const th_ycbcr_buffer planes, th_pixel_fmt pixel_fmt, int pic_x, int pic_y,
+                   int width, int height, const PackedFormat& format, unsigned char* dst, int dst_step);
+
+// Copies the width x height picture at (pic_x, pic_y) of a decoded frame into a
+// semi-planar or planar 4:2:0 image at dst, laid out as yuvImageSize expects.
+// 4:2:2 and 4:4:4 chroma is averaged down.
+void yCbCrToYuv(const th_ycbcr_buffer planes, th_pixel_fmt pixel_fmt, int pic_x, int pic_y,
+                int width, int height, const YuvFormat& format, unsigned char* dst, int dst_step);
+
+// Downscales a plane by two in both directions, averaging each 2x2 block. Writes
+// width x height samples to dst, reading 2 width x 2 height from src.
+void halvePlane(const unsigned char* src, int src_step, int width, int height,
+                unsigned char* dst, int dst_step);
+
+} //namespace theora_image_transport
+
+#endif
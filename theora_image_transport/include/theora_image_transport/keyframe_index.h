@@ -0,0 +1,110 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef THEORA_IMAGE_TRANSPORT_KEYFRAME_INDEX_H
+#define THEORA_IMAGE_TRANSPORT_KEYFRAME_INDEX_H
+
+#include <ros/time.h>
+#include <ogg/ogg.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+// ogg_saver writes an index of the keyframes next to each recording, so players can start
+// decoding anywhere without reading the file from the beginning. The index file is named after
+// the recording with ".idx" appended. It holds an 8 byte magic followed by one 36 byte little
+// endian record per keyframe, in recording order.
+namespace theora_image_transport {
+
+struct KeyframeIndexEntry
+{
+  ogg_uint64_t offset;        // Byte offset of the page starting with the keyframe
+  ogg_uint64_t header_offset; // Byte offset of the first header page of its logical stream
+  ogg_int64_t granulepos;
+  ros::Time stamp;            // Of the keyframe message
+  ogg_uint32_t serial;        // Of its logical stream
+};
+
+std::string keyframeIndexName(const std::string& recording);
+
+class KeyframeIndexWriter : private boost::noncopyable
+{
+public:
+  KeyframeIndexWriter();
+  ~KeyframeIndexWriter();
+
+  // Creates the index of the given recording, closing the previous one
+  bool open(const std::string& recording);
+  void close();
+
+  // Entries are flushed one by one, so they may get ahead of the recording when it is written
+  // asynchronously. KeyframeIndex ignores those past its end.
+  // track identifies the source of the keyframe across logical bitstreams. A keyframe not newer
+  // than the last one indexed for its track in this file is skipped and false returned: a new
+  // link repeats the last keyframe of each track, which the index already points to in the
+  // previous link.
+  bool append(const KeyframeIndexEntry& entry, int track);
+
+private:
+  FILE* file_;
+  std::map<int, ros::Time> last_stamps_; // Of the last keyframe indexed per track
+};
+
+class KeyframeIndex
+{
+public:
+  // Reads the index of the recording. Returns false if it is missing or malformed.
+  bool load(const std::string& recording);
+
+  const std::vector<KeyframeIndexEntry>& entries() const { return entries_; }
+
+  // Returns the last keyframe at or before stamp, or the first one if stamp precedes them all.
+  // NULL if the index is empty. Stamps are assumed not to decrease.
+  const KeyframeIndexEntry* find(const ros::Time& stamp) const;
+
+  // The same among the keyframes of one logical bitstream, for recordings of several streams
+  const KeyframeIndexEntry* find(const ros::Time& stamp, ogg_uint32_t serial) const;
+
+private:
+  std::vector<KeyframeIndexEntry> entries_;
+  std::map<ogg_uint32_t, std::vector<KeyframeIndexEntry> > streams_; // By serial number
+};
+
+} //namespace theora_image_transport
+
+#endif
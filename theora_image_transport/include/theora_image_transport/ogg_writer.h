@@ -0,0 +1,133 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef THEORA_IMAGE_TRANSPORT_OGG_WRITER_H
+#define THEORA_IMAGE_TRANSPORT_OGG_WRITER_H
+
+#include <ros/time.h>
+#include <ogg/ogg.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace theora_image_transport {
+
+// Writes Ogg pages to disk from a separate thread, so that recording never waits for the disk.
+// Pages are copied into large page aligned buffers, which the writer thread hands to write(2)
+// in one piece. On Linux, files are preallocated ahead of the data with fallocate to keep them
+// contiguous. When all buffers are waiting for the disk, writePage() blocks rather than lose
+// data, which would corrupt the Ogg stream.
+class OggWriter : private boost::noncopyable
+{
+public:
+  OggWriter(size_t buffer_size = 4 << 20, size_t max_buffers = 16, size_t preallocate_size = 64 << 20);
+
+  // Writes out everything queued and closes the file
+  ~OggWriter();
+
+  // Switches to a new file. Pages written so far still go to the previous one, which the writer
+  // thread closes when it is done with them. Returns false if the file can't be created, in
+  // which case pages are discarded until the next successful open().
+  bool open(const std::string& filename);
+
+  void writePage(const ogg_page& page);
+
+  // Hands the partly filled buffer to the writer thread. The writer thread also takes it on its
+  // own once it has waited for more than a second.
+  void flush();
+
+  // Bytes written to the current file so far, including those still queued
+  size_t fileSize() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return file_size_;
+  }
+
+  // Number of times writePage() had to wait for a free buffer
+  unsigned long stalls() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return stalls_;
+  }
+
+private:
+  struct Buffer : private boost::noncopyable
+  {
+    explicit Buffer(size_t capacity);
+    ~Buffer();
+    unsigned char* data;
+    size_t capacity, size;
+    int fd; // File the data belongs to, -1 to discard it
+  };
+  typedef boost::shared_ptr<Buffer> BufferPtr;
+
+  void append(boost::mutex::scoped_lock& lock, const unsigned char* data, size_t size);
+  void submit(boost::mutex::scoped_lock& lock);
+  void writerThread();
+  void writeBuffer(const Buffer& buffer);
+
+  size_t buffer_size_, max_buffers_, preallocate_size_;
+
+  // Buffers travel from free_ to current_, then through queue_ to the writer thread and back.
+  // The writer thread also takes current_ when it gets old. All fields below are guarded by
+  // mutex_; condition_ signals buffers queued or freed, data in an empty current_ and the thread
+  // stopping.
+  mutable boost::mutex mutex_;
+  int fd_;
+  size_t file_size_;
+  unsigned long stalls_;
+  BufferPtr current_;
+  ros::WallTime current_start_; // When the first byte went into current_
+  boost::condition_variable condition_;
+  std::deque<BufferPtr> queue_;
+  std::vector<BufferPtr> free_;
+  size_t allocated_buffers_;
+  bool stop_;
+  boost::shared_ptr<boost::thread> thread_;
+
+  // Owned by the writer thread
+  int writer_fd_;
+  size_t written_, reserved_; // Bytes written to and preallocated for writer_fd_
+};
+
+} //namespace theora_image_transport
+
+#endif
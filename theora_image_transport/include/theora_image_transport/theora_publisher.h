@@ -38,11 +38,18 @@
 #include <dynamic_reconfigure/server.h>
 #include <theora_image_transport/TheoraPublisherConfig.h>
 #include <theora_image_transport/Packet.h>
+#include <theora_image_transport/EncoderStatus.h>
 
 #include <theora/codec.h>
 #include <theora/theoraenc.h>
 #include <theora/theoradec.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <list>
+
 namespace theora_image_transport {
 
 class TheoraPublisher : public image_transport::SimplePublisherPlugin<theora_image_transport::Packet>
@@ -55,6 +62,15 @@ public:
   // Return the system unique string representing the theora transport type
   virtual std::string getTransportName() const { return "theora"; }
 
+  // Overridden to count subscribers of the scaled substreams too
+  virtual uint32_t getNumSubscribers() const;
+
+  // Overridden to stop the encoder thread before the publisher goes away
+  virtual void shutdown();
+
+  // Queue statistics of asynchronous encoding, also published on <base topic>/theora/encoder_status
+  theora_image_transport::EncoderStatus encoderStatus() const;
+
 protected:
   // Overridden to tweak arguments and set up reconfigure server
   virtual void advertiseImpl(ros::NodeHandle &nh, const std::string &base_topic, uint32_t queue_size,
@@ -76,19 +92,144 @@ protected:
 
   void configCb(Config& config, uint32_t level);
 
+  // A padded Y'CbCr frame ready for the encoder
+  struct Frame
+  {
+    std_msgs::Header header;
+    int width, height; // Picture size
+    th_pixel_fmt pixel_fmt;
+    std::string encoding; // Of the source image, announced in the stream comment
+    bool neutral_chroma; // Chroma planes hold nothing but 128, so mono images can skip them
+    ros::WallTime arrival; // When publish() was called, to measure the frame interval
+    cv::Mat y, cb, cr;
+    PublishFn publish_fn;
+  };
+  typedef boost::shared_ptr<Frame> FramePtr;
+
+  // An encoder the stream switched away from, kept with its header packets to switch back to
+  struct CachedContext
+  {
+    th_info setup;
+    boost::shared_ptr<th_enc_ctx> context;
+    std::vector<theora_image_transport::Packet> header;
+    std::string encoding;
+  };
+
+  // Encoder state of one published stream
+  struct Stream
+  {
+    Stream();
+    ~Stream();
+    th_info setup;
+    boost::shared_ptr<th_enc_ctx> context;
+    std::vector<theora_image_transport::Packet> header;
+    std::vector<theora_image_transport::Packet> gop_cache; // Last keyframe and the deltas since
+    std::string encoding; // Source encoding named in the stream header
+    theora_image_transport::Packet packet; // Reused for every video packet, which is serialized on publishing
+    std::list<CachedContext> context_cache; // Most recently used first
+    bool force_keyframe; // A restored context must start its subscribers over with a keyframe
+  };
+
+  // A downscaled copy of the stream, advertised as <base topic>_half or _quarter with its own encoder
+  struct Substream
+  {
+    int level; // The picture is halved this many times
+    ros::Publisher pub;
+    PublishFn publish_fn;
+    Stream stream;
+  };
+  typedef boost::shared_ptr<Substream> SubstreamPtr;
+
   // Utility functions
-  bool ensureEncodingContext(const sensor_msgs::Image& image, const PublishFn& publish_fn) const;
+  bool convertFrame(const sensor_msgs::Image& message, th_pixel_fmt pixel_fmt, Frame& frame) const;
+  void allocateFrame(Frame& frame, int width, int height, th_pixel_fmt pixel_fmt) const;
+  void halveFrame(const Frame& src, Frame& dst) const;
+  void encodeFrame(const Frame& frame) const;
+  void encodeSubstreams(const Frame& frame) const;
+  void encodeMainStream(const Frame& frame) const;
+  void submitFrame(Stream& stream, const Frame& frame, const std_msgs::Header* headers, int count,
+                   const PublishFn& publish_fn) const;
+  bool isDuplicate(const Frame& frame) const;
+  void flushDuplicates() const;
+  bool contextMatches(const Stream& stream, const Frame& frame) const;
+  bool ensureEncodingContext(Stream& stream, const Frame& frame, const PublishFn& publish_fn) const;
+  bool createContext(Stream& stream, const Frame& frame) const;
+  void cacheContext(Stream& stream) const;
+  bool restoreContext(Stream& stream, const Frame& frame) const;
+  void trimContextCache(Stream& stream, size_t size) const;
   void oggPacketToMsg(const std_msgs::Header& header, const ogg_packet &oggpacket,
                       theora_image_transport::Packet &msg) const;
-  void updateKeyframeFrequency() const;
+  void updateKeyframeFrequency(Stream& stream) const;
+  void cacheGopPacket(Stream& stream, bool keyframe, const theora_image_transport::Packet& msg) const;
+  void setSpeedLevel(int level) const;
+  bool applySpeedLevel(Stream& stream, int level) const;
+  void updateSubstreams(const Config& config);
+  void substreamConnectCallback(const ros::SingleSubscriberPublisher& pub, const boost::weak_ptr<Substream>& substream);
+  void sendStreamStart(const Stream& stream, const ros::SingleSubscriberPublisher& pub) const;
+  void adaptSpeedLevel(double encode_time, const ros::WallTime& arrival) const;
+  void updateFrameRate(const Frame& frame) const;
+  bool frameRateDrifted(const Stream& stream) const;
+
+  // Asynchronous encoding
+  void startEncoderThread();
+  void stopEncoderThread();
+  void encoderThread();
+  void fillEncoderStatus(theora_image_transport::EncoderStatus& status) const; // Needs queue_mutex_
 
   // Some data is preserved across calls to publish(), but from the user's perspective publish() is
   // "logically const"
   mutable cv_bridge::CvImage img_image_;
-  mutable th_info encoder_setup_;
+  mutable Stream stream_;
   mutable ogg_uint32_t keyframe_frequency_;
-  mutable boost::shared_ptr<th_enc_ctx> encoding_context_;
-  mutable std::vector<theora_image_transport::Packet> stream_header_;
+  bool gop_cache_enabled_;
+  size_t context_cache_size_; // Cached contexts per stream
+  mutable Frame frame_; // Reused while the size is unchanged when encoding synchronously
+  mutable boost::mutex encoder_mutex_; // Guards the streams, substreams, pyramid and speed control
+
+  // Scaled substreams share the conversion of the full frame. Level i of the pyramid holds the
+  // frame halved i + 1 times.
+  ros::NodeHandle advertise_nh_;
+  std::string base_topic_;
+  uint32_t advertise_queue_size_;
+  mutable std::vector<SubstreamPtr> substreams_; // Changed under both encoder_mutex_ and substream_mutex_
+  mutable boost::mutex substream_mutex_; // Lets getNumSubscribers() read substreams_ while a frame is encoded
+  mutable std::vector<Frame> pyramid_;
+
+  // Speed level control. Encode time and frame interval are exponential moving averages in seconds.
+  int speed_level_config_; // -1 for adaptive
+  double encode_time_budget_;
+  mutable int speed_level_, speed_level_max_;
+  mutable double encode_time_, frame_interval_;
+  mutable ros::WallTime last_arrival_;
+  mutable int frames_since_speed_change_;
+
+  // Frame rate for the rate controller, measured from the stamps of the last frames. The encoder
+  // is rebuilt when it drifts, as libtheora only takes the frame rate at setup.
+  mutable std::deque<double> frame_stamps_;
+  mutable double frame_rate_; // 0 until the window is full
+
+  // Duplicate frames are held back until the run ends, then sent as one re-encode of the reference
+  // frame followed by zero byte packets, each with the header of the frame it stands for
+  double duplicate_threshold_; // Mean absolute difference per block, -1 to disable
+  int max_duplicate_run_;
+  mutable Frame reference_; // Copy of the last frame encoded while duplicate detection is on
+  mutable std::vector<std_msgs::Header> duplicate_headers_;
+  mutable PublishFn duplicate_publish_fn_;
+
+  // Frames converted in publish() and waiting for the encoder thread. All fields below are guarded
+  // by queue_mutex_; queue_condition_ signals new frames and the encoder thread stopping.
+  mutable boost::mutex queue_mutex_;
+  mutable boost::condition_variable queue_condition_;
+  mutable std::deque<FramePtr> queue_, free_frames_;
+  boost::shared_ptr<boost::thread> encoder_thread_;
+  bool encoder_running_, stop_encoder_;
+  size_t queue_size_;
+  int drop_policy_;
+  th_pixel_fmt pixel_fmt_; // Requested chroma subsampling
+  mutable unsigned long encoded_frames_, dropped_frames_;
+  mutable size_t max_queue_depth_;
+  ros::Publisher status_pub_;
+  ros::WallTime last_status_; // Only used by the encoder thread
 };
 
 } //namespace compressed_image_transport
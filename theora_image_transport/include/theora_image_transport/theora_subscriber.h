@@ -41,6 +41,10 @@
 #include <theora/theoraenc.h>
 #include <theora/theoradec.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 namespace theora_image_transport {
 
 class TheoraSubscriber : public image_transport::SimpleSubscriberPlugin<theora_image_transport::Packet>
@@ -51,6 +55,9 @@ public:
 
   virtual std::string getTransportName() const { return "theora"; }
 
+  // Overridden to stop the conversion thread before the subscriber goes away
+  virtual void shutdown();
+
 protected:
   // Overridden to bump queue_size, otherwise we might lose headers
   // Overridden to tweak arguments and set up reconfigure server
@@ -66,20 +73,57 @@ protected:
   typedef dynamic_reconfigure::Server<Config> ReconfigureServer;
   boost::shared_ptr<ReconfigureServer> reconfigure_server_;
   int pplevel_; // Post-processing level
+  std::string output_encoding_; // Set by the reconfigure server thread, guarded by ring_mutex_
 
   void configCb(Config& config, uint32_t level);
 
+  // A decoded frame on its way to the user callback
+  struct DecodedFrame
+  {
+    std_msgs::Header header;
+    unsigned long generation; // Of the stream, new headers start the next one
+    bool duplicate; // Repeats the previous frame and carries no planes
+    int width, height, pic_x, pic_y;
+    th_pixel_fmt pixel_fmt;
+    bool mono_source;
+    std::string encoding; // Requested output encoding
+    th_ycbcr_buffer planes; // Into the decoder, or into storage when queued for the conversion thread
+    std::vector<unsigned char> storage[3];
+    Callback callback;
+  };
+
   // Utility functions
   int updatePostProcessingLevel(int level);
   void msgToOggPacket(const theora_image_transport::Packet &msg, ogg_packet &ogg);
+  void deliverFrame(const DecodedFrame& frame);
+  void queueFrame(const DecodedFrame& frame);
+
+  // Pipelined decoding
+  void startConversionThread();
+  void stopConversionThread();
+  void conversionThread();
 
   bool received_header_;
   bool received_keyframe_;
+  bool mono_source_; // The stream comment says the images were mono8
   th_dec_ctx* decoding_context_;
   th_info header_info_;
   th_comment header_comment_;
   th_setup_info* setup_info_;
+  unsigned long generation_; // Bumped by every beginning of stream
   sensor_msgs::ImagePtr latest_image_;
+  unsigned long latest_generation_;
+
+  // Ring of decoded frames waiting for the conversion thread, which owns latest_image_ while it
+  // runs. All fields below are guarded by ring_mutex_; ring_condition_ signals frames queued,
+  // slots freed and the thread stopping.
+  boost::mutex ring_mutex_;
+  boost::condition_variable ring_condition_;
+  std::vector<DecodedFrame> ring_;
+  size_t ring_head_, ring_count_;
+  boost::shared_ptr<boost::thread> conversion_thread_;
+  bool stop_conversion_, conversion_running_;
+  bool* conversion_detached_; // Flag on the stack of the conversion thread, see stopConversionThread()
 };
 
 } //namespace theora_image_transport
@@ -0,0 +1,561 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/image_encodings.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <theora_image_transport/Packet.h>
+#include <theora_image_transport/theora_subscriber.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+namespace enc = sensor_msgs::image_encodings;
+
+// Decodes the theora and compressed image topics of a bag to image files or to raw images in a
+// new bag, as fast as the machine allows instead of at the recorded rate. The bag is read on the
+// main thread. Every theora stream gets a decoder thread of its own, as its packets depend on
+// each other, while compressed frames are independent and go to a pool of worker threads, which
+// also encode the image files. A single thread writes the results. All stages are connected by
+// bounded queues, so a slow disk holds the reader back instead of piling up decoded images.
+
+// Hands items from one stage to the next. push() blocks while the queue is full and pop() while
+// it is empty; pop() returns false once the queue is closed and drained.
+template <class T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+  void push(const T& item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (items_.size() >= capacity_)
+      not_full_.wait(lock);
+    items_.push_back(item);
+    not_empty_.notify_one();
+  }
+
+  bool pop(T& item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (items_.empty() && !closed_)
+      not_empty_.wait(lock);
+    if (items_.empty())
+      return false;
+    item = items_.front();
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool closed_;
+  std::deque<T> items_;
+  boost::mutex mutex_;
+  boost::condition_variable not_full_, not_empty_;
+};
+
+// Runs the decoder of the subscriber plugin on packets read from the bag
+class TheoraDecoder : public theora_image_transport::TheoraSubscriber
+{
+public:
+  void decode(const theora_image_transport::PacketConstPtr& packet, const Callback& callback)
+  {
+    // The plugin restamps its last image in place for duplicate frames, but that image may still
+    // be queued for encoding or writing, so duplicates get a copy of their own
+    if (packet->data.empty() && latest_image_)
+      latest_image_ = boost::make_shared<sensor_msgs::Image>(*latest_image_);
+    internalCallback(packet, callback);
+  }
+};
+
+class BagTranscoder
+{
+public:
+  struct Options
+  {
+    Options() : format("png"), quality(-1), threads(0), queue_size(64) {}
+    std::string output_dir; // Image files go to one directory per topic below this
+    std::string output_bag; // Or raw images to this bag
+    std::string format; // Extension of the image files, png, jpg or anything else imencode knows
+    int quality; // PNG compression level or JPEG quality, -1 for the default of OpenCV
+    int threads; // Worker threads, 0 for one per core
+    size_t queue_size; // Frames waiting between stages
+  };
+
+  explicit BagTranscoder(const Options& options)
+    : options_(options), workers_(options.queue_size), outputs_(options.queue_size), messages_(0),
+      written_(0), failed_(0)
+  {
+    if (options_.threads <= 0)
+      options_.threads = std::max(1u, boost::thread::hardware_concurrency());
+    if (options_.quality >= 0) {
+      if (options_.format == "jpg" || options_.format == "jpeg") {
+        encode_params_.push_back(cv::IMWRITE_JPEG_QUALITY);
+        encode_params_.push_back(options_.quality);
+      }
+      else if (options_.format == "png") {
+        encode_params_.push_back(cv::IMWRITE_PNG_COMPRESSION);
+        encode_params_.push_back(options_.quality);
+      }
+    }
+  }
+
+  bool run(const std::string& input, const std::vector<std::string>& topics)
+  {
+    rosbag::Bag bag;
+    try {
+      bag.open(input, rosbag::bagmode::Read);
+      if (!options_.output_bag.empty())
+        output_bag_.open(options_.output_bag, rosbag::bagmode::Write);
+    }
+    catch (rosbag::BagException& e) {
+      ROS_ERROR("%s", e.what());
+      return false;
+    }
+
+    std::vector<std::string> selected;
+    if (!selectTopics(bag, topics, selected))
+      return false;
+    if (options_.output_bag.empty() && !makeDirectory(options_.output_dir))
+      return false;
+    for (size_t i = 0; i < selected.size(); i++) {
+      if (options_.output_bag.empty() && !makeDirectory(outputName(selected[i])))
+        return false;
+      frame_numbers_[selected[i]] = 0;
+    }
+
+    ros::WallTime start = ros::WallTime::now();
+    startThreads();
+    rosbag::View view(bag, rosbag::TopicQuery(selected));
+    for (rosbag::View::iterator it = view.begin(); it != view.end(); ++it) {
+      messages_++;
+      std::map<std::string, TheoraStreamPtr>::iterator theora = theora_streams_.find(it->getTopic());
+      if (theora != theora_streams_.end()) {
+        theora_image_transport::PacketConstPtr packet = it->instantiate<theora_image_transport::Packet>();
+        if (packet)
+          theora->second->packets.push(make_pair(packet, it->getTime()));
+        continue;
+      }
+      sensor_msgs::CompressedImageConstPtr compressed = it->instantiate<sensor_msgs::CompressedImage>();
+      if (compressed) {
+        workers_.push(boost::bind(&BagTranscoder::decodeCompressed, this, compressed, it->getTopic(),
+                                  nextFrame(it->getTopic()), it->getTime()));
+      }
+    }
+    stopThreads();
+    bag.close();
+    if (!options_.output_bag.empty())
+      output_bag_.close();
+
+    double elapsed = (ros::WallTime::now() - start).toSec();
+    ROS_INFO("Wrote %lu images from %lu messages in %.1f s (%.1f images/s), %lu failed",
+             written_, messages_, elapsed, elapsed > 0.0 ? written_ / elapsed : 0.0, failed_);
+    return failed_ == 0;
+  }
+
+private:
+  typedef std::pair<theora_image_transport::PacketConstPtr, ros::Time> TimedPacket;
+
+  // A theora topic and its decoder thread
+  struct TheoraStream
+  {
+    explicit TheoraStream(size_t queue_size) : packets(queue_size) {}
+    std::string topic;
+    TheoraDecoder decoder;
+    BoundedQueue<TimedPacket> packets;
+    ros::Time time; // Of the packet being decoded, for the output bag
+    boost::shared_ptr<boost::thread> thread;
+  };
+  typedef boost::shared_ptr<TheoraStream> TheoraStreamPtr;
+
+  // A finished frame for the writer thread: the contents of an image file, or an image for the
+  // output bag
+  struct Output
+  {
+    std::string name; // Path or topic
+    std::vector<unsigned char> data;
+    sensor_msgs::ImageConstPtr image;
+    ros::Time time;
+  };
+
+  // Picks the theora and compressed image topics among the requested ones, or in the whole bag
+  bool selectTopics(rosbag::Bag& bag, const std::vector<std::string>& topics, std::vector<std::string>& selected)
+  {
+    std::set<std::string> requested(topics.begin(), topics.end()), missing(requested);
+    rosbag::View view(bag);
+    std::vector<const rosbag::ConnectionInfo*> connections = view.getConnections();
+    std::set<std::string> seen;
+    for (size_t i = 0; i < connections.size(); i++) {
+      const std::string& topic = connections[i]->topic;
+      const std::string& type = connections[i]->datatype;
+      if (!seen.insert(topic).second || (!requested.empty() && !requested.count(topic)))
+        continue;
+      missing.erase(topic);
+      if (type == "theora_image_transport/Packet") {
+        TheoraStreamPtr stream = boost::make_shared<TheoraStream>(options_.queue_size);
+        stream->topic = topic;
+        theora_streams_[topic] = stream;
+      }
+      else if (type == "sensor_msgs/CompressedImage") {
+        if (topic.size() >= 15 && topic.compare(topic.size() - 15, 15, "compressedDepth") == 0) {
+          ROS_WARN("Skipping %s, depth images are not supported", topic.c_str());
+          continue;
+        }
+      }
+      else {
+        if (!topics.empty())
+          ROS_WARN("Skipping %s of type %s", topic.c_str(), type.c_str());
+        continue;
+      }
+      selected.push_back(topic);
+    }
+    for (std::set<std::string>::iterator it = missing.begin(); it != missing.end(); ++it)
+      ROS_WARN("Topic %s is not in the bag", it->c_str());
+    if (selected.empty()) {
+      ROS_ERROR("No theora or compressed image topics to transcode");
+      return false;
+    }
+    return true;
+  }
+
+  // Image files of a topic go to <output_dir>/<topic with slashes as underscores>. Images in the
+  // output bag go to the base topic the transport was published on.
+  std::string outputName(const std::string& topic) const
+  {
+    std::string name = topic;
+    if (!options_.output_bag.empty()) {
+      size_t slash = name.rfind('/');
+      std::string transport = name.substr(slash + 1);
+      if (slash != std::string::npos && slash > 0 && (transport == "theora" || transport == "compressed"))
+        return name.substr(0, slash);
+      return name + "_raw";
+    }
+    size_t first = name.find_first_not_of('/');
+    name = first == std::string::npos ? "image" : name.substr(first);
+    for (size_t i = 0; i < name.size(); i++) {
+      if (name[i] == '/')
+        name[i] = '_';
+    }
+    return options_.output_dir + "/" + name;
+  }
+
+  bool makeDirectory(const std::string& path) const
+  {
+    if (mkdir(path.c_str(), 0755) && errno != EEXIST) {
+      ROS_ERROR("Unable to create %s: %s", path.c_str(), strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
+  // Numbers the frames of each topic in bag order, so file names sort like the recording even
+  // where stamps repeat. Each counter is only touched by the thread reading the topic's frames:
+  // the decoder thread for theora topics and the main thread for compressed ones.
+  unsigned long nextFrame(const std::string& topic)
+  {
+    return frame_numbers_.find(topic)->second++;
+  }
+
+  std::string fileName(const std::string& topic, unsigned long frame, const ros::Time& stamp) const
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "/%06lu_%u.%09u.", frame, stamp.sec, stamp.nsec);
+    return outputName(topic) + name + options_.format;
+  }
+
+  void startThreads()
+  {
+    for (std::map<std::string, TheoraStreamPtr>::iterator it = theora_streams_.begin(); it != theora_streams_.end(); ++it)
+      it->second->thread = boost::make_shared<boost::thread>(boost::bind(&BagTranscoder::theoraThread, this, it->second.get()));
+    for (int i = 0; i < options_.threads; i++)
+      worker_threads_.create_thread(boost::bind(&BagTranscoder::workerThread, this));
+    writer_thread_ = boost::make_shared<boost::thread>(boost::bind(&BagTranscoder::writerThread, this));
+  }
+
+  // Stops the stages front to back, each after the ones feeding it have drained
+  void stopThreads()
+  {
+    for (std::map<std::string, TheoraStreamPtr>::iterator it = theora_streams_.begin(); it != theora_streams_.end(); ++it) {
+      it->second->packets.close();
+      it->second->thread->join();
+    }
+    workers_.close();
+    worker_threads_.join_all();
+    outputs_.close();
+    writer_thread_->join();
+  }
+
+  void theoraThread(TheoraStream* stream)
+  {
+    TheoraDecoder::Callback callback = boost::bind(&BagTranscoder::theoraFrame, this, stream, _1);
+    TimedPacket packet;
+    while (stream->packets.pop(packet)) {
+      stream->time = packet.second;
+      stream->decoder.decode(packet.first, callback);
+    }
+  }
+
+  // Called on the decoder thread of the stream for every decoded frame
+  void theoraFrame(TheoraStream* stream, const sensor_msgs::ImageConstPtr& image)
+  {
+    if (!options_.output_bag.empty()) {
+      Output output;
+      output.name = outputName(stream->topic);
+      output.image = image;
+      output.time = stream->time;
+      outputs_.push(output);
+      return;
+    }
+    workers_.push(boost::bind(&BagTranscoder::encodeImage, this, image,
+                              fileName(stream->topic, nextFrame(stream->topic), image->header.stamp)));
+  }
+
+  void decodeCompressed(const sensor_msgs::CompressedImageConstPtr& message, const std::string& topic,
+                        unsigned long frame, const ros::Time& time)
+  {
+    if (message->format.find("compressedDepth") != std::string::npos) {
+      ROS_WARN_THROTTLE(10, "Skipping depth image on %s", topic.c_str());
+      return;
+    }
+    cv_bridge::CvImage decoded;
+    decoded.header = message->header;
+    try {
+      decoded.image = cv::imdecode(cv::Mat(message->data), cv::IMREAD_UNCHANGED);
+    }
+    catch (cv::Exception& e) {
+      ROS_ERROR("%s", e.what());
+    }
+    if (decoded.image.empty()) {
+      ROS_ERROR("Unable to decode frame %lu of %s (%s)", frame, topic.c_str(), message->format.c_str());
+      countFailure();
+      return;
+    }
+    if (options_.output_bag.empty()) {
+      encodeMat(decoded.image, fileName(topic, frame, message->header.stamp));
+      return;
+    }
+
+    // imdecode returns the channels in OpenCV's order, whatever the original encoding was
+    bool wide = decoded.image.depth() == CV_16U;
+    switch (decoded.image.channels()) {
+      case 1:
+        decoded.encoding = wide ? enc::MONO16 : enc::MONO8;
+        break;
+      case 3:
+        decoded.encoding = wide ? enc::BGR16 : enc::BGR8;
+        break;
+      default:
+        decoded.encoding = wide ? enc::BGRA16 : enc::BGRA8;
+        break;
+    }
+    Output output;
+    output.name = outputName(topic);
+    output.image = decoded.toImageMsg();
+    output.time = time;
+    outputs_.push(output);
+  }
+
+  void encodeImage(const sensor_msgs::ImageConstPtr& image, const std::string& path)
+  {
+    cv_bridge::CvImageConstPtr cv_image;
+    try {
+      // Theora frames come as bgr8 or mono8, which need no conversion
+      cv_image = cv_bridge::toCvShare(image, enc::isColor(image->encoding) ? enc::BGR8 : "");
+    }
+    catch (cv_bridge::Exception& e) {
+      ROS_ERROR("Unable to convert %s: %s", path.c_str(), e.what());
+      countFailure();
+      return;
+    }
+    encodeMat(cv_image->image, path);
+  }
+
+  void encodeMat(const cv::Mat& image, const std::string& path)
+  {
+    Output output;
+    output.name = path;
+    bool encoded = false;
+    try {
+      encoded = cv::imencode("." + options_.format, image, output.data, encode_params_);
+    }
+    catch (cv::Exception& e) {
+      ROS_ERROR("%s", e.what());
+    }
+    if (!encoded) {
+      ROS_ERROR("Unable to encode %s", path.c_str());
+      countFailure();
+      return;
+    }
+    outputs_.push(output);
+  }
+
+  void countFailure()
+  {
+    boost::mutex::scoped_lock lock(failed_mutex_);
+    failed_++;
+  }
+
+  void workerThread()
+  {
+    boost::function<void()> job;
+    while (workers_.pop(job))
+      job();
+  }
+
+  void writerThread()
+  {
+    Output output;
+    while (outputs_.pop(output)) {
+      if (output.image) {
+        try {
+          output_bag_.write(output.name, output.time, output.image);
+        }
+        catch (rosbag::BagException& e) {
+          ROS_ERROR("%s", e.what());
+          countFailure();
+          continue;
+        }
+      }
+      else {
+        FILE* file = fopen(output.name.c_str(), "wb");
+        bool ok = file && (output.data.empty() ||
+                           fwrite(&output.data[0], 1, output.data.size(), file) == output.data.size());
+        if (file && fclose(file))
+          ok = false;
+        if (!ok) {
+          ROS_ERROR("Unable to write %s: %s", output.name.c_str(), strerror(errno));
+          countFailure();
+          continue;
+        }
+      }
+      written_++;
+    }
+  }
+
+  Options options_;
+  std::vector<int> encode_params_;
+  rosbag::Bag output_bag_; // Only used by the writer thread once the bag is read
+  std::map<std::string, TheoraStreamPtr> theora_streams_;
+  std::map<std::string, unsigned long> frame_numbers_; // Filled before the threads start
+  BoundedQueue<boost::function<void()> > workers_;
+  boost::thread_group worker_threads_;
+  BoundedQueue<Output> outputs_;
+  boost::shared_ptr<boost::thread> writer_thread_;
+  unsigned long messages_, written_, failed_;
+  boost::mutex failed_mutex_;
+};
+
+static void usage(const char* name)
+{
+  cerr << "Usage: " << name << " [options] input.bag [topic ...]" << endl
+       << "Decodes theora and compressed image topics, all of them if none are given." << endl
+       << "  -o dir     Write image files to one directory per topic below dir" << endl
+       << "             (default: the bag name without .bag)" << endl
+       << "  -b bag     Write raw images to a bag instead" << endl
+       << "  -f format  Image file format, png (default), jpg, ppm, ..." << endl
+       << "  -q n       PNG compression level or JPEG quality" << endl
+       << "  -j n       Worker threads (default: one per core)" << endl
+       << "  -Q n       Frames queued between stages (default: 64)" << endl;
+}
+
+int main(int argc, char** argv)
+{
+  ros::Time::init();
+
+  BagTranscoder::Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:b:f:q:j:Q:h")) != -1) {
+    switch (opt) {
+      case 'o': options.output_dir = optarg; break;
+      case 'b': options.output_bag = optarg; break;
+      case 'f': options.format = optarg; break;
+      case 'q': options.quality = atoi(optarg); break;
+      case 'j': options.threads = atoi(optarg); break;
+      case 'Q': options.queue_size = std::max(1, atoi(optarg)); break;
+      default:
+        usage(argv[0]);
+        exit(3);
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    exit(3);
+  }
+
+  std::string input = argv[optind];
+  if (options.output_dir.empty()) {
+    options.output_dir = input;
+    if (input.size() > 4 && input.compare(input.size() - 4, 4, ".bag") == 0)
+      options.output_dir.resize(input.size() - 4);
+    else
+      options.output_dir += "_images";
+  }
+
+  BagTranscoder transcoder(options);
+  std::vector<std::string> topics(argv + optind + 1, argv + argc);
+  return transcoder.run(input, topics) ? 0 : 1;
+}
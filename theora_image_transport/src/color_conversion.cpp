@@ -0,0 +1,855 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/color_conversion.h"
+#include <sensor_msgs/image_encodings.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace enc = sensor_msgs::image_encodings;
+
+namespace theora_image_transport {
+
+// Full range BT.601 in fixed point, small enough that every product fits a 16 bit lane:
+//   Y  = (77 R + 150 G + 29 B + 128) >> 8
+//   Cr = 128 + 0.713 (R - Y),  Cb = 128 + 0.564 (B - Y)
+// Chroma is computed from the sum of a 2x2 block, i.e. with a further factor of 1/4, as
+// round(diff * kCoef / 4096) where kCoef = 4096 * coefficient / 4. The SIMD code gets
+// floor(2 x) as the high half of (32 diff) * kCoef and rounds that half up.
+enum
+{
+  kR2Y = 77, kG2Y = 150, kB2Y = 29,
+  kCr = 730, kCb = 578,
+  kStrip = 64 // Pixels unpacked at a time, a multiple of the 16 pixel SIMD block
+};
+
+static inline unsigned char saturate(int value)
+{
+  return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline int luma(int r, int g, int b)
+{
+  return (r * kR2Y + g * kG2Y + b * kB2Y + 128) >> 8;
+}
+
+static inline unsigned char chroma(int diff, int coef)
+{
+  return saturate(128 + ((((diff * 32 * coef) >> 16) + 1) >> 1));
+}
+
+bool packedFormatFromEncoding(const std::string& encoding, PackedFormat& format)
+{
+  static const PackedFormat mono = {1, 0, 0, 0}, bgr = {3, 2, 1, 0}, rgb = {3, 0, 1, 2},
+                            bgra = {4, 2, 1, 0}, rgba = {4, 0, 1, 2};
+  if (encoding == enc::MONO8)
+    format = mono;
+  else if (encoding == enc::BGR8)
+    format = bgr;
+  else if (encoding == enc::RGB8)
+    format = rgb;
+  else if (encoding == enc::BGRA8)
+    format = bgra;
+  else if (encoding == enc::RGBA8)
+    format = rgba;
+  else
+    return false;
+  return true;
+}
+
+// Planar copy of two rows of up to kStrip pixels, padded to an even count.
+struct Strip
+{
+  short r[2][kStrip], g[2][kStrip], b[2][kStrip];
+};
+
+// Converts an even number of pixels from a strip.
+static void convertStrip(const Strip& s, int n, unsigned char* y0, unsigned char* y1,
+                         unsigned char* cb, unsigned char* cr)
+{
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i r2y = _mm_set1_epi16(kR2Y), g2y = _mm_set1_epi16(kG2Y), b2y = _mm_set1_epi16(kB2Y);
+  const __m128i round = _mm_set1_epi16(128), one = _mm_set1_epi16(1);
+  const __m128i cr_coef = _mm_set1_epi16(kCr), cb_coef = _mm_set1_epi16(kCb);
+  for (; x + 16 <= n; x += 16)
+  {
+    __m128i sum_y[2], sum_r[2], sum_b[2];
+    unsigned char* y_out[2] = {y0, y1};
+    for (int half = 0; half < 2; half++)
+    {
+      const int i = x + 8 * half;
+      __m128i l[2];
+      for (int row = 0; row < 2; row++)
+      {
+        __m128i r = _mm_loadu_si128((const __m128i*)&s.r[row][i]);
+        __m128i g = _mm_loadu_si128((const __m128i*)&s.g[row][i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&s.b[row][i]);
+        __m128i acc = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, r2y), _mm_mullo_epi16(g, g2y)),
+                                    _mm_add_epi16(_mm_mullo_epi16(b, b2y), round));
+        l[row] = _mm_srli_epi16(acc, 8);
+      }
+      _mm_storel_epi64((__m128i*)(y_out[0] + i), _mm_packus_epi16(l[0], l[0]));
+      _mm_storel_epi64((__m128i*)(y_out[1] + i), _mm_packus_epi16(l[1], l[1]));
+      // Horizontal pairs of the vertical sums, four 32 bit lanes each
+      sum_y[half] = _mm_madd_epi16(_mm_add_epi16(l[0], l[1]), one);
+      sum_r[half] = _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)&s.r[0][i]),
+                                                 _mm_loadu_si128((const __m128i*)&s.r[1][i])), one);
+      sum_b[half] = _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)&s.b[0][i]),
+                                                 _mm_loadu_si128((const __m128i*)&s.b[1][i])), one);
+    }
+    __m128i y4 = _mm_packs_epi32(sum_y[0], sum_y[1]);
+    __m128i dr = _mm_slli_epi16(_mm_sub_epi16(_mm_packs_epi32(sum_r[0], sum_r[1]), y4), 5);
+    __m128i db = _mm_slli_epi16(_mm_sub_epi16(_mm_packs_epi32(sum_b[0], sum_b[1]), y4), 5);
+    __m128i vr = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mulhi_epi16(dr, cr_coef), one), 1), round);
+    __m128i vb = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mulhi_epi16(db, cb_coef), one), 1), round);
+    _mm_storel_epi64((__m128i*)(cr + x / 2), _mm_packus_epi16(vr, vr));
+    _mm_storel_epi64((__m128i*)(cb + x / 2), _mm_packus_epi16(vb, vb));
+  }
+#elif defined(__ARM_NEON)
+  const int16x8_t round = vdupq_n_s16(128);
+  for (; x + 16 <= n; x += 16)
+  {
+    int16x8_t sum_y[2], sum_r[2], sum_b[2];
+    unsigned char* y_out[2] = {y0, y1};
+    for (int half = 0; half < 2; half++)
+    {
+      const int i = x + 8 * half;
+      uint16x8_t l[2];
+      for (int row = 0; row < 2; row++)
+      {
+        uint16x8_t r = vreinterpretq_u16_s16(vld1q_s16(&s.r[row][i]));
+        uint16x8_t g = vreinterpretq_u16_s16(vld1q_s16(&s.g[row][i]));
+        uint16x8_t b = vreinterpretq_u16_s16(vld1q_s16(&s.b[row][i]));
+        uint16x8_t acc = vmlaq_n_u16(vmlaq_n_u16(vmulq_n_u16(r, kR2Y), g, kG2Y), b, kB2Y);
+        l[row] = vrshrq_n_u16(acc, 8);
+        vst1_u8(y_out[row] + i, vqmovn_u16(l[row]));
+      }
+      sum_y[half] = vreinterpretq_s16_u16(vaddq_u16(l[0], l[1]));
+      sum_r[half] = vaddq_s16(vld1q_s16(&s.r[0][i]), vld1q_s16(&s.r[1][i]));
+      sum_b[half] = vaddq_s16(vld1q_s16(&s.b[0][i]), vld1q_s16(&s.b[1][i]));
+    }
+    // Horizontal pairs of the vertical sums
+    int16x8_t y4 = vcombine_s16(vmovn_s32(vpaddlq_s16(sum_y[0])), vmovn_s32(vpaddlq_s16(sum_y[1])));
+    int16x8_t r4 = vcombine_s16(vmovn_s32(vpaddlq_s16(sum_r[0])), vmovn_s32(vpaddlq_s16(sum_r[1])));
+    int16x8_t b4 = vcombine_s16(vmovn_s32(vpaddlq_s16(sum_b[0])), vmovn_s32(vpaddlq_s16(sum_b[1])));
+    // vqdmulh is (2 a b) >> 16, so scale the difference by 16 rather than 32
+    int16x8_t vr = vqdmulhq_n_s16(vshlq_n_s16(vsubq_s16(r4, y4), 4), kCr);
+    int16x8_t vb = vqdmulhq_n_s16(vshlq_n_s16(vsubq_s16(b4, y4), 4), kCb);
+    vr = vaddq_s16(vshrq_n_s16(vaddq_s16(vr, vdupq_n_s16(1)), 1), round);
+    vb = vaddq_s16(vshrq_n_s16(vaddq_s16(vb, vdupq_n_s16(1)), 1), round);
+    vst1_u8(cr + x / 2, vqmovun_s16(vr));
+    vst1_u8(cb + x / 2, vqmovun_s16(vb));
+  }
+#endif
+  for (; x < n; x += 2)
+  {
+    int l00 = luma(s.r[0][x], s.g[0][x], s.b[0][x]), l01 = luma(s.r[0][x + 1], s.g[0][x + 1], s.b[0][x + 1]);
+    int l10 = luma(s.r[1][x], s.g[1][x], s.b[1][x]), l11 = luma(s.r[1][x + 1], s.g[1][x + 1], s.b[1][x + 1]);
+    y0[x] = l00;
+    y0[x + 1] = l01;
+    y1[x] = l10;
+    y1[x + 1] = l11;
+    int sum_y = l00 + l01 + l10 + l11;
+    cr[x / 2] = chroma(s.r[0][x] + s.r[0][x + 1] + s.r[1][x] + s.r[1][x + 1] - sum_y, kCr);
+    cb[x / 2] = chroma(s.b[0][x] + s.b[0][x + 1] + s.b[1][x] + s.b[1][x + 1] - sum_y, kCb);
+  }
+}
+
+// Converts two rows of width pixels. The channel layout is a template parameter so that the
+// unpacking has constant strides and shifts.
+template <int C, int R, int G, int B>
+static void convertRowPair(const unsigned char* src0, const unsigned char* src1, int width,
+                           unsigned char* y0, unsigned char* y1, unsigned char* cb, unsigned char* cr)
+{
+  Strip strip;
+  for (int x0 = 0; x0 < width; x0 += kStrip)
+  {
+    const int n = std::min<int>(kStrip, width - x0);
+    const unsigned char* rows[2] = {src0 + C * x0, src1 + C * x0};
+    for (int row = 0; row < 2; row++)
+    {
+      const unsigned char* p = rows[row];
+      int i = 0;
+#if defined(__SSE2__)
+      // Gather four pixels per register as 32 bit lanes. For 3 channel images each load reads
+      // four bytes past the pixels it uses, so stop two pixels early.
+      const __m128i byte_mask = _mm_set1_epi32(0xff);
+      for (; i + 8 + (C == 3 ? 2 : 0) <= n; i += 8, p += 8 * C)
+      {
+        __m128i lo, hi;
+        if (C == 4)
+        {
+          lo = _mm_loadu_si128((const __m128i*)p);
+          hi = _mm_loadu_si128((const __m128i*)(p + 16));
+        }
+        else
+        {
+          __m128i a = _mm_loadu_si128((const __m128i*)p), b = _mm_loadu_si128((const __m128i*)(p + 12));
+          lo = _mm_unpacklo_epi64(_mm_unpacklo_epi32(a, _mm_srli_si128(a, 3)),
+                                  _mm_unpacklo_epi32(_mm_srli_si128(a, 6), _mm_srli_si128(a, 9)));
+          hi = _mm_unpacklo_epi64(_mm_unpacklo_epi32(b, _mm_srli_si128(b, 3)),
+                                  _mm_unpacklo_epi32(_mm_srli_si128(b, 6), _mm_srli_si128(b, 9)));
+        }
+        _mm_storeu_si128((__m128i*)&strip.r[row][i],
+                         _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8 * R), byte_mask),
+                                         _mm_and_si128(_mm_srli_epi32(hi, 8 * R), byte_mask)));
+        _mm_storeu_si128((__m128i*)&strip.g[row][i],
+                         _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8 * G), byte_mask),
+                                         _mm_and_si128(_mm_srli_epi32(hi, 8 * G), byte_mask)));
+        _mm_storeu_si128((__m128i*)&strip.b[row][i],
+                         _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8 * B), byte_mask),
+                                         _mm_and_si128(_mm_srli_epi32(hi, 8 * B), byte_mask)));
+      }
+#elif defined(__ARM_NEON)
+      for (; i + 8 <= n; i += 8, p += 8 * C)
+      {
+        uint8x8_t r, g, b;
+        if (C == 4)
+        {
+          uint8x8x4_t v = vld4_u8(p);
+          r = v.val[R], g = v.val[G], b = v.val[B];
+        }
+        else
+        {
+          uint8x8x3_t v = vld3_u8(p);
+          r = v.val[R], g = v.val[G], b = v.val[B];
+        }
+        vst1q_s16(&strip.r[row][i], vreinterpretq_s16_u16(vmovl_u8(r)));
+        vst1q_s16(&strip.g[row][i], vreinterpretq_s16_u16(vmovl_u8(g)));
+        vst1q_s16(&strip.b[row][i], vreinterpretq_s16_u16(vmovl_u8(b)));
+      }
+#endif
+      for (; i < n; i++, p += C)
+      {
+        strip.r[row][i] = p[R];
+        strip.g[row][i] = p[G];
+        strip.b[row][i] = p[B];
+      }
+      // Replicate the last column of odd width images. The extra luma lands in the padding.
+      if (n & 1)
+      {
+        strip.r[row][n] = strip.r[row][n - 1];
+        strip.g[row][n] = strip.g[row][n - 1];
+        strip.b[row][n] = strip.b[row][n - 1];
+      }
+    }
+    convertStrip(strip, (n + 1) & ~1, y0 + x0, y1 + x0, cb + x0 / 2, cr + x0 / 2);
+  }
+}
+
+template <int C, int R, int G, int B>
+static void convertImage(const unsigned char* src, int src_step, int width, int height, int ydec,
+                         th_ycbcr_buffer planes)
+{
+  th_img_plane &y = planes[0], &cb = planes[1], &cr = planes[2];
+  if (!ydec)
+  {
+    // 4:2:2 pairs each row with itself, which averages horizontally only
+    for (int row = 0; row < height; row++)
+    {
+      unsigned char* y_row = y.data + row * y.stride;
+      convertRowPair<C, R, G, B>(src + row * src_step, src + row * src_step, width, y_row, y_row,
+                                 cb.data + row * cb.stride, cr.data + row * cr.stride);
+    }
+    return;
+  }
+  for (int row = 0; row < height; row += 2)
+  {
+    // Replicate the last row of odd height images. Its luma lands in the padding too.
+    const int next = row + 1 < height ? row + 1 : row;
+    convertRowPair<C, R, G, B>(src + row * src_step, src + next * src_step, width,
+                               y.data + row * y.stride, y.data + (row + 1) * y.stride,
+                               cb.data + (row / 2) * cb.stride, cr.data + (row / 2) * cr.stride);
+  }
+}
+
+void packedToYCbCr(const unsigned char* src, int src_step, int width, int height,
+                   const PackedFormat& format, th_pixel_fmt pixel_fmt, th_ycbcr_buffer planes)
+{
+  const int ydec = pixel_fmt == TH_PF_420 ? 1 : 0;
+  if (format.channels == 1)
+  {
+    for (int row = 0; row < height; row++)
+      memcpy(planes[0].data + row * planes[0].stride, src + row * src_step, width);
+  }
+  else if (format.channels == 3 && format.b == 0)
+    convertImage<3, 2, 1, 0>(src, src_step, width, height, ydec, planes);
+  else if (format.channels == 3)
+    convertImage<3, 0, 1, 2>(src, src_step, width, height, ydec, planes);
+  else if (format.b == 0)
+    convertImage<4, 2, 1, 0>(src, src_step, width, height, ydec, planes);
+  else
+    convertImage<4, 0, 1, 2>(src, src_step, width, height, ydec, planes);
+}
+
+bool yuvFormatFromEncoding(const std::string& encoding, YuvFormat& format)
+{
+  // Only yuv422 (UYVY byte order) is defined by every sensor_msgs release, the other names are
+  // matched as drivers commonly spell them.
+  static const YuvFormat uyvy = {YuvFormat::PACKED_422, 1, 0, 2}, yuyv = {YuvFormat::PACKED_422, 0, 1, 3},
+                         nv12 = {YuvFormat::SEMI_PLANAR_420, 0, 0, 1}, nv21 = {YuvFormat::SEMI_PLANAR_420, 0, 1, 0},
+                         i420 = {YuvFormat::PLANAR_420, 0, 1, 2}, yv12 = {YuvFormat::PLANAR_420, 0, 2, 1};
+  if (encoding == enc::YUV422 || encoding == "uyvy")
+    format = uyvy;
+  else if (encoding == "yuv422_yuy2" || encoding == "yuyv" || encoding == "yuy2")
+    format = yuyv;
+  else if (encoding == "nv12")
+    format = nv12;
+  else if (encoding == "nv21")
+    format = nv21;
+  else if (encoding == "i420")
+    format = i420;
+  else if (encoding == "yv12")
+    format = yv12;
+  else
+    return false;
+  return true;
+}
+
+size_t yuvImageSize(const YuvFormat& format, int width, int height, int step)
+{
+  const size_t chroma_rows = (height + 1) / 2;
+  switch (format.layout)
+  {
+    case YuvFormat::PACKED_422:
+      return step < 4 * ((width + 1) / 2) ? 0 : (size_t)step * height;
+    case YuvFormat::SEMI_PLANAR_420:
+      return step < 2 * ((width + 1) / 2) ? 0 : (size_t)step * (height + chroma_rows);
+    case YuvFormat::PLANAR_420:
+    default:
+      return step < 2 * ((width + 1) / 2) ? 0 : (size_t)step * height + 2 * (size_t)((step + 1) / 2) * chroma_rows;
+  }
+}
+
+// Rounded average of two rows, as used when dropping vertical chroma resolution
+static void averageRows(const unsigned char* a, const unsigned char* b, int n, unsigned char* dst)
+{
+  int i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16)
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                                       _mm_loadu_si128((const __m128i*)(b + i))));
+#elif defined(__ARM_NEON)
+  for (; i + 16 <= n; i += 16)
+    vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+#endif
+  for (; i < n; i++)
+    dst[i] = (a[i] + b[i] + 1) >> 1;
+}
+
+// Splits n macro pixels of a packed 4:2:2 row into luma and chroma.
+static void deinterleave422(const unsigned char* src, int n, const YuvFormat& format,
+                            unsigned char* y, unsigned char* cb, unsigned char* cr)
+{
+  int i = 0;
+#if defined(__SSE2__)
+  // Luma sits in either the low or the high byte of each 16 bit lane, chroma in the other one,
+  // alternating Cb and Cr.
+  const __m128i low_byte = _mm_set1_epi16(0xff), low_word = _mm_set1_epi32(0xffff);
+  const bool luma_high = format.y == 1, cb_first = format.cb < format.cr;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i v0 = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 4 * i + 16));
+    __m128i y0 = luma_high ? _mm_srli_epi16(v0, 8) : _mm_and_si128(v0, low_byte);
+    __m128i y1 = luma_high ? _mm_srli_epi16(v1, 8) : _mm_and_si128(v1, low_byte);
+    __m128i c0 = luma_high ? _mm_and_si128(v0, low_byte) : _mm_srli_epi16(v0, 8);
+    __m128i c1 = luma_high ? _mm_and_si128(v1, low_byte) : _mm_srli_epi16(v1, 8);
+    __m128i first = _mm_packs_epi32(_mm_and_si128(c0, low_word), _mm_and_si128(c1, low_word));
+    __m128i second = _mm_packs_epi32(_mm_srli_epi32(c0, 16), _mm_srli_epi32(c1, 16));
+    _mm_storeu_si128((__m128i*)(y + 2 * i), _mm_packus_epi16(y0, y1));
+    _mm_storel_epi64((__m128i*)(cb + i), _mm_packus_epi16(cb_first ? first : second, first));
+    _mm_storel_epi64((__m128i*)(cr + i), _mm_packus_epi16(cb_first ? second : first, first));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= n; i += 8)
+  {
+    uint8x8x4_t v = vld4_u8(src + 4 * i);
+    uint8x8x2_t luma = {{v.val[format.y], v.val[format.y + 2]}};
+    vst2_u8(y + 2 * i, luma);
+    vst1_u8(cb + i, v.val[format.cb]);
+    vst1_u8(cr + i, v.val[format.cr]);
+  }
+#endif
+  for (; i < n; i++)
+  {
+    const unsigned char* p = src + 4 * i;
+    y[2 * i] = p[format.y];
+    y[2 * i + 1] = p[format.y + 2];
+    cb[i] = p[format.cb];
+    cr[i] = p[format.cr];
+  }
+}
+
+// Splits n interleaved chroma pairs.
+static void deinterleavePairs(const unsigned char* src, int n, const YuvFormat& format,
+                              unsigned char* cb, unsigned char* cr)
+{
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128i low_byte = _mm_set1_epi16(0xff);
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i v0 = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+    __m128i first = _mm_packus_epi16(_mm_and_si128(v0, low_byte), _mm_and_si128(v1, low_byte));
+    __m128i second = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+    _mm_storeu_si128((__m128i*)(cb + i), format.cb == 0 ? first : second);
+    _mm_storeu_si128((__m128i*)(cr + i), format.cb == 0 ? second : first);
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 16 <= n; i += 16)
+  {
+    uint8x16x2_t v = vld2q_u8(src + 2 * i);
+    vst1q_u8(cb + i, v.val[format.cb]);
+    vst1q_u8(cr + i, v.val[format.cr]);
+  }
+#endif
+  for (; i < n; i++)
+  {
+    cb[i] = src[2 * i + format.cb];
+    cr[i] = src[2 * i + format.cr];
+  }
+}
+
+void yuvToYCbCr(const unsigned char* src, int src_step, int width, int height,
+                const YuvFormat& format, th_pixel_fmt pixel_fmt, th_ycbcr_buffer planes)
+{
+  th_img_plane &y = planes[0], &cb = planes[1], &cr = planes[2];
+  const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  const bool keep_rows = pixel_fmt != TH_PF_420;
+
+  if (format.layout == YuvFormat::PACKED_422)
+  {
+    for (int row = 0; row < height; row++)
+    {
+      unsigned char* cb_row = cb.data + (keep_rows ? row : row / 2) * cb.stride;
+      unsigned char* cr_row = cr.data + (keep_rows ? row : row / 2) * cr.stride;
+      if (keep_rows || !(row & 1))
+      {
+        deinterleave422(src + row * src_step, chroma_width, format, y.data + row * y.stride, cb_row, cr_row);
+        continue;
+      }
+      // Odd rows of 4:2:0 output average their chroma into the row above
+      unsigned char cb_tmp[kStrip], cr_tmp[kStrip];
+      for (int x = 0; x < chroma_width; x += kStrip)
+      {
+        const int n = std::min<int>(kStrip, chroma_width - x);
+        deinterleave422(src + row * src_step + 4 * x, n, format, y.data + row * y.stride + 2 * x, cb_tmp, cr_tmp);
+        averageRows(cb_row + x, cb_tmp, n, cb_row + x);
+        averageRows(cr_row + x, cr_tmp, n, cr_row + x);
+      }
+    }
+    return;
+  }
+
+  for (int row = 0; row < height; row++)
+    memcpy(y.data + row * y.stride, src + row * src_step, width);
+
+  const unsigned char* chroma = src + (size_t)src_step * height;
+  const int chroma_step = format.layout == YuvFormat::PLANAR_420 ? (src_step + 1) / 2 : src_step;
+  const unsigned char* planar[3] = {NULL, chroma, chroma + (size_t)chroma_step * chroma_height};
+  for (int row = 0; row < chroma_height; row++)
+  {
+    // Chroma rows are doubled for 4:2:2 output, the second copy may land in the padding
+    const int out_row = keep_rows ? 2 * row : row;
+    unsigned char* cb_row = cb.data + out_row * cb.stride;
+    unsigned char* cr_row = cr.data + out_row * cr.stride;
+    if (format.layout == YuvFormat::SEMI_PLANAR_420)
+      deinterleavePairs(chroma + row * chroma_step, chroma_width, format, cb_row, cr_row);
+    else
+    {
+      memcpy(cb_row, planar[format.cb] + row * chroma_step, chroma_width);
+      memcpy(cr_row, planar[format.cr] + row * chroma_step, chroma_width);
+    }
+    if (keep_rows)
+    {
+      memcpy(cb_row + cb.stride, cb_row, chroma_width);
+      memcpy(cr_row + cr.stride, cr_row, chroma_width);
+    }
+  }
+}
+
+// Interleaves n chroma pairs.
+static void interleavePairs(const unsigned char* cb, const unsigned char* cr, int n, const YuvFormat& format,
+                            unsigned char* dst)
+{
+  const unsigned char* first = format.cb == 0 ? cb : cr;
+  const unsigned char* second = format.cb == 0 ? cr : cb;
+  int i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(first + i)), b = _mm_loadu_si128((const __m128i*)(second + i));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(a, b));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 16 <= n; i += 16)
+  {
+    uint8x16x2_t v = {{vld1q_u8(first + i), vld1q_u8(second + i)}};
+    vst2q_u8(dst + 2 * i, v);
+  }
+#endif
+  for (; i < n; i++)
+  {
+    dst[2 * i] = first[i];
+    dst[2 * i + 1] = second[i];
+  }
+}
+
+void yCbCrToYuv(const th_ycbcr_buffer planes, th_pixel_fmt pixel_fmt, int pic_x, int pic_y,
+                int width, int height, const YuvFormat& format, unsigned char* dst, int dst_step)
+{
+  const th_img_plane &y = planes[0];
+  for (int row = 0; row < height; row++)
+    memcpy(dst + row * dst_step, y.data + (pic_y + row) * y.stride + pic_x, width);
+
+  const int xdec = pixel_fmt == TH_PF_444 ? 0 : 1, ydec = pixel_fmt == TH_PF_420 ? 1 : 0;
+  const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  unsigned char* chroma = dst + (size_t)dst_step * height;
+  const int chroma_step = format.layout == YuvFormat::PLANAR_420 ? (dst_step + 1) / 2 : dst_step;
+  unsigned char* planar[3] = {NULL, chroma, chroma + (size_t)chroma_step * chroma_height};
+
+  // Chroma rows of the picture in the output resolution, resampled first if needed
+  std::vector<unsigned char> resampled;
+  if (xdec == 0 || ydec == 0)
+    resampled.resize(2 * chroma_width);
+  for (int row = 0; row < chroma_height; row++)
+  {
+    const unsigned char* src[3];
+    for (int c = 1; c < 3; c++)
+    {
+      const th_img_plane& plane = planes[c];
+      if (ydec && xdec)
+      {
+        src[c] = plane.data + ((pic_y >> 1) + row) * plane.stride + (pic_x >> 1);
+        continue;
+      }
+      // Average the two source rows, and for 4:4:4 the two source columns, of each sample
+      const int row0 = pic_y + 2 * row, row1 = std::min(row0 + 1, pic_y + height - 1);
+      const unsigned char* a = plane.data + row0 * plane.stride + (pic_x >> xdec);
+      const unsigned char* b = plane.data + row1 * plane.stride + (pic_x >> xdec);
+      unsigned char* out = &resampled[(c - 1) * chroma_width];
+      if (xdec)
+        averageRows(a, b, chroma_width, out);
+      else
+      {
+        for (int x = 0; x < chroma_width; x++)
+        {
+          const int x1 = std::min(2 * x + 1, width - 1);
+          out[x] = (a[2 * x] + a[x1] + b[2 * x] + b[x1] + 2) >> 2;
+        }
+      }
+      src[c] = out;
+    }
+
+    if (format.layout == YuvFormat::SEMI_PLANAR_420)
+      interleavePairs(src[1], src[2], chroma_width, format, chroma + row * chroma_step);
+    else
+    {
+      memcpy(planar[format.cb] + row * chroma_step, src[1], chroma_width);
+      memcpy(planar[format.cr] + row * chroma_step, src[2], chroma_width);
+    }
+  }
+}
+
+// Inverse transform, with chroma terms as round(d * kCoef / 1024) for d = C - 128:
+//   R = Y + 1.403 dCr,  G = Y - 0.714 dCr - 0.344 dCb,  B = Y + 1.773 dCb
+// As above, the SIMD code computes floor(2 x) as the high half of (128 d) * kCoef.
+enum
+{
+  kCr2R = 1437, kCr2G = 731, kCb2G = 352, kCb2B = 1816
+};
+
+static inline int chromaTerm(int d, int coef)
+{
+  return (d * 128 * coef) >> 16;
+}
+
+#if defined(__SSE2__)
+// Computes the R, G and B offsets of eight chroma samples, given as 16 bit lanes.
+static inline void chromaTerms(__m128i cb, __m128i cr, __m128i& r, __m128i& g, __m128i& b)
+{
+  const __m128i offset = _mm_set1_epi16(128), one = _mm_set1_epi16(1);
+  const __m128i dcb = _mm_slli_epi16(_mm_sub_epi16(cb, offset), 7);
+  const __m128i dcr = _mm_slli_epi16(_mm_sub_epi16(cr, offset), 7);
+  r = _mm_srai_epi16(_mm_add_epi16(_mm_mulhi_epi16(dcr, _mm_set1_epi16(kCr2R)), one), 1);
+  g = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mulhi_epi16(dcr, _mm_set1_epi16(kCr2G)),
+                                                 _mm_mulhi_epi16(dcb, _mm_set1_epi16(kCb2G))), one), 1);
+  b = _mm_srai_epi16(_mm_add_epi16(_mm_mulhi_epi16(dcb, _mm_set1_epi16(kCb2B)), one), 1);
+}
+
+// Writes 16 pixels. Packed 3 channel pixels are squeezed out of 4 channel registers.
+template <int C, int R, int G, int B>
+static inline void storePixels(unsigned char* dst, __m128i r, __m128i g, __m128i b)
+{
+  __m128i ch[4];
+  ch[R] = r;
+  ch[G] = g;
+  ch[B] = b;
+  ch[3] = _mm_set1_epi8((char)0xff);
+  __m128i t0 = _mm_unpacklo_epi8(ch[0], ch[1]), t1 = _mm_unpackhi_epi8(ch[0], ch[1]);
+  __m128i t2 = _mm_unpacklo_epi8(ch[2], ch[3]), t3 = _mm_unpackhi_epi8(ch[2], ch[3]);
+  __m128i px[4] = {_mm_unpacklo_epi16(t0, t2), _mm_unpackhi_epi16(t0, t2),
+                   _mm_unpacklo_epi16(t1, t3), _mm_unpackhi_epi16(t1, t3)};
+  if (C == 4)
+  {
+    for (int k = 0; k < 4; k++)
+      _mm_storeu_si128((__m128i*)(dst + 16 * k), px[k]);
+    return;
+  }
+  // Byte masks of the first and second pixel in each 64 bit half, the latter after shifting
+  // it down by one byte, and of the six bytes they form
+  const __m128i first = _mm_set_epi32(0, 0xffffff, 0, 0xffffff);
+  const __m128i second = _mm_set_epi32(0xffff, (int)0xff000000, 0xffff, (int)0xff000000);
+  const __m128i six = _mm_set_epi32(0, 0, 0xffff, -1);
+  for (int k = 0; k < 4; k++)
+  {
+    __m128i v = _mm_or_si128(_mm_and_si128(px[k], first), _mm_and_si128(_mm_srli_epi64(px[k], 8), second));
+    v = _mm_or_si128(_mm_and_si128(v, six), _mm_slli_si128(_mm_srli_si128(v, 8), 6));
+    // Only the last store has to stop exactly after its 12 bytes
+    if (k < 3)
+      _mm_storeu_si128((__m128i*)(dst + 12 * k), v);
+    else
+    {
+      _mm_storel_epi64((__m128i*)(dst + 36), v);
+      int tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+      memcpy(dst + 44, &tail, 4);
+    }
+  }
+}
+#elif defined(__ARM_NEON)
+static inline void chromaTerms(int16x8_t cb, int16x8_t cr, int16x8_t& r, int16x8_t& g, int16x8_t& b)
+{
+  // vqdmulh is (2 a b) >> 16, so scale the difference by 64 rather than 128
+  const int16x8_t offset = vdupq_n_s16(128), one = vdupq_n_s16(1);
+  const int16x8_t dcb = vshlq_n_s16(vsubq_s16(cb, offset), 6);
+  const int16x8_t dcr = vshlq_n_s16(vsubq_s16(cr, offset), 6);
+  r = vshrq_n_s16(vaddq_s16(vqdmulhq_n_s16(dcr, kCr2R), one), 1);
+  g = vshrq_n_s16(vaddq_s16(vaddq_s16(vqdmulhq_n_s16(dcr, kCr2G), vqdmulhq_n_s16(dcb, kCb2G)), one), 1);
+  b = vshrq_n_s16(vaddq_s16(vqdmulhq_n_s16(dcb, kCb2B), one), 1);
+}
+
+template <int C, int R, int G, int B>
+static inline void storePixels(unsigned char* dst, uint8x16_t r, uint8x16_t g, uint8x16_t b)
+{
+  if (C == 4)
+  {
+    uint8x16x4_t v;
+    v.val[R] = r;
+    v.val[G] = g;
+    v.val[B] = b;
+    v.val[3] = vdupq_n_u8(255);
+    vst4q_u8(dst, v);
+  }
+  else
+  {
+    uint8x16x3_t v;
+    v.val[R] = r;
+    v.val[G] = g;
+    v.val[B] = b;
+    vst3q_u8(dst, v);
+  }
+}
+#endif
+
+template <int C, int R, int G, int B>
+static inline void convertPixelOut(int luma, int cb, int cr, unsigned char* p)
+{
+  const int dcb = cb - 128, dcr = cr - 128;
+  p[R] = saturate(luma + ((chromaTerm(dcr, kCr2R) + 1) >> 1));
+  p[G] = saturate(luma - ((chromaTerm(dcr, kCr2G) + chromaTerm(dcb, kCb2G) + 1) >> 1));
+  p[B] = saturate(luma + ((chromaTerm(dcb, kCb2B) + 1) >> 1));
+  if (C == 4)
+    p[3] = 255;
+}
+
+// Converts one row of width pixels starting at luma column x0. xdec is 1 if chroma is
+// horizontally subsampled.
+template <int C, int R, int G, int B>
+static void convertRowOut(const unsigned char* y, const unsigned char* cb, const unsigned char* cr,
+                          int x0, int xdec, int width, unsigned char* dst)
+{
+  int x = 0;
+  // Start the SIMD blocks on a chroma sample boundary
+  if ((x0 & xdec) && width > 0)
+  {
+    convertPixelOut<C, R, G, B>(y[x0], cb[x0 >> xdec], cr[x0 >> xdec], dst);
+    x = 1;
+  }
+#if defined(__SSE2__) || defined(__ARM_NEON)
+  for (; x + 16 <= width; x += 16)
+  {
+    const int cx = (x0 + x) >> xdec;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i term_r[2], term_g[2], term_b[2];
+    if (xdec)
+    {
+      __m128i r8, g8, b8;
+      chromaTerms(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cb + cx)), zero),
+                  _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cr + cx)), zero), r8, g8, b8);
+      term_r[0] = _mm_unpacklo_epi16(r8, r8), term_r[1] = _mm_unpackhi_epi16(r8, r8);
+      term_g[0] = _mm_unpacklo_epi16(g8, g8), term_g[1] = _mm_unpackhi_epi16(g8, g8);
+      term_b[0] = _mm_unpacklo_epi16(b8, b8), term_b[1] = _mm_unpackhi_epi16(b8, b8);
+    }
+    else
+    {
+      __m128i cb16 = _mm_loadu_si128((const __m128i*)(cb + cx));
+      __m128i cr16 = _mm_loadu_si128((const __m128i*)(cr + cx));
+      chromaTerms(_mm_unpacklo_epi8(cb16, zero), _mm_unpacklo_epi8(cr16, zero), term_r[0], term_g[0], term_b[0]);
+      chromaTerms(_mm_unpackhi_epi8(cb16, zero), _mm_unpackhi_epi8(cr16, zero), term_r[1], term_g[1], term_b[1]);
+    }
+    __m128i y16 = _mm_loadu_si128((const __m128i*)(y + x0 + x));
+    __m128i luma[2] = {_mm_unpacklo_epi8(y16, zero), _mm_unpackhi_epi8(y16, zero)};
+    storePixels<C, R, G, B>(dst + C * x,
+                            _mm_packus_epi16(_mm_add_epi16(luma[0], term_r[0]), _mm_add_epi16(luma[1], term_r[1])),
+                            _mm_packus_epi16(_mm_sub_epi16(luma[0], term_g[0]), _mm_sub_epi16(luma[1], term_g[1])),
+                            _mm_packus_epi16(_mm_add_epi16(luma[0], term_b[0]), _mm_add_epi16(luma[1], term_b[1])));
+#else
+    int16x8_t term_r[2], term_g[2], term_b[2];
+    if (xdec)
+    {
+      int16x8_t r8, g8, b8;
+      chromaTerms(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(cb + cx))),
+                  vreinterpretq_s16_u16(vmovl_u8(vld1_u8(cr + cx))), r8, g8, b8);
+      int16x8x2_t zr = vzipq_s16(r8, r8), zg = vzipq_s16(g8, g8), zb = vzipq_s16(b8, b8);
+      term_r[0] = zr.val[0], term_r[1] = zr.val[1];
+      term_g[0] = zg.val[0], term_g[1] = zg.val[1];
+      term_b[0] = zb.val[0], term_b[1] = zb.val[1];
+    }
+    else
+    {
+      uint8x16_t cb16 = vld1q_u8(cb + cx), cr16 = vld1q_u8(cr + cx);
+      chromaTerms(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(cb16))),
+                  vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(cr16))), term_r[0], term_g[0], term_b[0]);
+      chromaTerms(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(cb16))),
+                  vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(cr16))), term_r[1], term_g[1], term_b[1]);
+    }
+    uint8x16_t y16 = vld1q_u8(y + x0 + x);
+    int16x8_t luma[2] = {vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y16))),
+                         vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y16)))};
+    storePixels<C, R, G, B>(dst + C * x,
+                            vcombine_u8(vqmovun_s16(vaddq_s16(luma[0], term_r[0])), vqmovun_s16(vaddq_s16(luma[1], term_r[1]))),
+                            vcombine_u8(vqmovun_s16(vsubq_s16(luma[0], term_g[0])), vqmovun_s16(vsubq_s16(luma[1], term_g[1]))),
+                            vcombine_u8(vqmovun_s16(vaddq_s16(luma[0], term_b[0])), vqmovun_s16(vaddq_s16(luma[1], term_b[1]))));
+#endif
+  }
+#endif
+  for (; x < width; x++)
+    convertPixelOut<C, R, G, B>(y[x0 + x], cb[(x0 + x) >> xdec], cr[(x0 + x) >> xdec], dst + C * x);
+}
+
+template <int C, int R, int G, int B>
+static void convertImageOut(const th_ycbcr_buffer planes, int xdec, int ydec, int pic_x, int pic_y,
+                            int width, int height, unsigned char* dst, int dst_step)
+{
+  const th_img_plane &y = planes[0], &cb = planes[1], &cr = planes[2];
+  for (int row = 0; row < height; row++)
+  {
+    const int luma_row = pic_y + row, chroma_row = luma_row >> ydec;
+    convertRowOut<C, R, G, B>(y.data + luma_row * y.stride, cb.data + chroma_row * cb.stride,
+                              cr.data + chroma_row * cr.stride, pic_x, xdec, width, dst + row * dst_step);
+  }
+}
+
+void yCbCrToPacked(const th_ycbcr_buffer planes, th_pixel_fmt pixel_fmt, int pic_x, int pic_y,
+                   int width, int height, const PackedFormat& format, unsigned char* dst, int dst_step)
+{
+  if (format.channels == 1)
+  {
+    for (int row = 0; row < height; row++)
+      memcpy(dst + row * dst_step, planes[0].data + (pic_y + row) * planes[0].stride + pic_x, width);
+    return;
+  }
+  const int xdec = pixel_fmt == TH_PF_444 ? 0 : 1;
+  const int ydec = pixel_fmt == TH_PF_420 ? 1 : 0;
+  if (format.channels == 3 && format.b == 0)
+    convertImageOut<3, 2, 1, 0>(planes, xdec, ydec, pic_x, pic_y, width, height, dst, dst_step);
+  else if (format.channels == 3)
+    convertImageOut<3, 0, 1, 2>(planes, xdec, ydec, pic_x, pic_y, width, height, dst, dst_step);
+  else if (format.b == 0)
+    convertImageOut<4, 2, 1, 0>(planes, xdec, ydec, pic_x, pic_y, width, height, dst, dst_step);
+  else
+    convertImageOut<4, 0, 1, 2>(planes, xdec, ydec, pic_x, pic_y, width, height, dst, dst_step);
+}
+
+void halvePlane(const unsigned char* src, int src_step, int width, int height,
+                unsigned char* dst, int dst_step)
+{
+  for (int row = 0; row < height; row++)
+  {
+    const unsigned char* top = src + 2 * row * src_step;
+    const unsigned char* bottom = top + src_step;
+    unsigned char* out = dst + row * dst_step;
+    int x = 0;
+#if defined(__SSE2__)
+    // Sum even and odd bytes of both rows in 16 bit lanes, then round and pack
+    const __m128i low_bytes = _mm_set1_epi16(0xFF), two = _mm_set1_epi16(2);
+    for (; x + 16 <= width; x += 16)
+    {
+      __m128i sums[2];
+      for (int half = 0; half < 2; half++)
+      {
+        __m128i t = _mm_loadu_si128((const __m128i*)(top + 2 * x + 16 * half));
+        __m128i b = _mm_loadu_si128((const __m128i*)(bottom + 2 * x + 16 * half));
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(t, low_bytes), _mm_srli_epi16(t, 8)),
+                                    _mm_add_epi16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8)));
+        sums[half] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+      }
+      _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(sums[0], sums[1]));
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 8 <= width; x += 8)
+    {
+      uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(top + 2 * x)), vpaddlq_u8(vld1q_u8(bottom + 2 * x)));
+      vst1_u8(out + x, vrshrn_n_u16(sum, 2));
+    }
+#endif
+    for (; x < width; x++)
+      out[x] = (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2;
+  }
+}
+
+} //namespace theora_image_transport
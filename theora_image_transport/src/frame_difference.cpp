@@ -0,0 +1,91 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/frame_difference.h"
+
+#include <cstdlib>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace theora_image_transport {
+
+// Adds the absolute differences of 8 byte groups of one row to the sum of their block.
+static void accumulateRow(const unsigned char* a, const unsigned char* b, int width, int block_width,
+                          unsigned* sums)
+{
+  int x = 0;
+#if defined(__SSE2__)
+  for (; x + 16 <= width; x += 16)
+  {
+    __m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + x)), _mm_loadu_si128((const __m128i*)(b + x)));
+    sums[x / block_width] += _mm_cvtsi128_si32(sad);
+    sums[(x + 8) / block_width] += _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+  }
+#elif defined(__ARM_NEON)
+  for (; x + 16 <= width; x += 16)
+  {
+    uint64x2_t sad = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x)))));
+    sums[x / block_width] += (unsigned)vgetq_lane_u64(sad, 0);
+    sums[(x + 8) / block_width] += (unsigned)vgetq_lane_u64(sad, 1);
+  }
+#endif
+  for (; x < width; x++)
+    sums[x / block_width] += std::abs(a[x] - b[x]);
+}
+
+bool blocksWithinLimit(const unsigned char* a, int a_step, const unsigned char* b, int b_step,
+                       int width, int height, int block_width, int block_height, unsigned limit)
+{
+  const int blocks = (width + block_width - 1) / block_width;
+  std::vector<unsigned> sums(blocks);
+  for (int y0 = 0; y0 < height; y0 += block_height)
+  {
+    sums.assign(blocks, 0);
+    for (int y = y0; y < y0 + block_height && y < height; y++)
+      accumulateRow(a + y * a_step, b + y * b_step, width, block_width, &sums[0]);
+    for (int i = 0; i < blocks; i++)
+    {
+      if (sums[i] > limit)
+        return false;
+    }
+  }
+  return true;
+}
+
+} //namespace theora_image_transport
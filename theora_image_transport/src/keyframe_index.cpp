@@ -0,0 +1,181 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/keyframe_index.h"
+
+#include <ros/console.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace theora_image_transport {
+
+static const char index_magic[8] = {'T', 'H', 'K', 'F', 'I', 'D', 'X', '1'};
+static const size_t entry_size = 36;
+
+static void putLE(unsigned char* dst, ogg_uint64_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+    dst[i] = (unsigned char)(value >> (8 * i));
+}
+
+static ogg_uint64_t getLE(const unsigned char* src, int bytes)
+{
+  ogg_uint64_t value = 0;
+  for (int i = 0; i < bytes; i++)
+    value |= (ogg_uint64_t)src[i] << (8 * i);
+  return value;
+}
+
+static bool stampLess(const ros::Time& stamp, const KeyframeIndexEntry& entry)
+{
+  return stamp < entry.stamp;
+}
+
+static const KeyframeIndexEntry* findEntry(const std::vector<KeyframeIndexEntry>& entries, const ros::Time& stamp)
+{
+  if (entries.empty())
+    return NULL;
+  std::vector<KeyframeIndexEntry>::const_iterator it =
+      std::upper_bound(entries.begin(), entries.end(), stamp, stampLess);
+  return it == entries.begin() ? &*it : &*(it - 1);
+}
+
+std::string keyframeIndexName(const std::string& recording)
+{
+  return recording + ".idx";
+}
+
+KeyframeIndexWriter::KeyframeIndexWriter()
+  : file_(NULL)
+{
+}
+
+KeyframeIndexWriter::~KeyframeIndexWriter()
+{
+  close();
+}
+
+bool KeyframeIndexWriter::open(const std::string& recording)
+{
+  close();
+  last_stamps_.clear();
+  std::string filename = keyframeIndexName(recording);
+  file_ = fopen(filename.c_str(), "wb");
+  if (!file_) {
+    ROS_ERROR("Unable to open %s for writing: %s", filename.c_str(), strerror(errno));
+    return false;
+  }
+  fwrite(index_magic, 1, sizeof(index_magic), file_);
+  return true;
+}
+
+void KeyframeIndexWriter::close()
+{
+  if (file_)
+    fclose(file_);
+  file_ = NULL;
+}
+
+bool KeyframeIndexWriter::append(const KeyframeIndexEntry& entry, int track)
+{
+  if (!file_)
+    return false;
+  std::map<int, ros::Time>::iterator last = last_stamps_.find(track);
+  if (last != last_stamps_.end() && !(last->second < entry.stamp))
+    return false;
+  last_stamps_[track] = entry.stamp;
+  unsigned char record[entry_size];
+  putLE(record, entry.offset, 8);
+  putLE(record + 8, entry.header_offset, 8);
+  putLE(record + 16, (ogg_uint64_t)entry.granulepos, 8);
+  putLE(record + 24, entry.stamp.toNSec(), 8);
+  putLE(record + 32, entry.serial, 4);
+  if (fwrite(record, 1, entry_size, file_) != entry_size || fflush(file_))
+    ROS_ERROR_THROTTLE(5.0, "Failed to write keyframe index: %s", strerror(errno));
+  return true;
+}
+
+bool KeyframeIndex::load(const std::string& recording)
+{
+  entries_.clear();
+  streams_.clear();
+  struct stat recording_stat;
+  if (stat(recording.c_str(), &recording_stat))
+    return false;
+
+  std::string filename = keyframeIndexName(recording);
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (!file)
+    return false;
+  char magic[sizeof(index_magic)];
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, index_magic, sizeof(magic))) {
+    ROS_ERROR("%s is not a keyframe index", filename.c_str());
+    fclose(file);
+    return false;
+  }
+
+  unsigned char record[entry_size];
+  while (fread(record, 1, entry_size, file) == entry_size) {
+    KeyframeIndexEntry entry;
+    entry.offset = getLE(record, 8);
+    entry.header_offset = getLE(record + 8, 8);
+    entry.granulepos = (ogg_int64_t)getLE(record + 16, 8);
+    entry.stamp.fromNSec(getLE(record + 24, 8));
+    entry.serial = (ogg_uint32_t)getLE(record + 32, 4);
+    // Entries of pages that never made it to disk
+    if (entry.offset >= (ogg_uint64_t)recording_stat.st_size)
+      break;
+    entries_.push_back(entry);
+    streams_[entry.serial].push_back(entry);
+  }
+  fclose(file);
+  return true;
+}
+
+const KeyframeIndexEntry* KeyframeIndex::find(const ros::Time& stamp) const
+{
+  return findEntry(entries_, stamp);
+}
+
+const KeyframeIndexEntry* KeyframeIndex::find(const ros::Time& stamp, ogg_uint32_t serial) const
+{
+  std::map<ogg_uint32_t, std::vector<KeyframeIndexEntry> >::const_iterator it = streams_.find(serial);
+  return it == streams_.end() ? NULL : findEntry(it->second, stamp);
+}
+
+} //namespace theora_image_transport
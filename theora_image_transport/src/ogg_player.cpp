@@ -0,0 +1,451 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ros/ros.h>
+
+#include <theora_image_transport/Packet.h>
+#include <theora_image_transport/keyframe_index.h>
+
+#include <theora/codec.h>
+#include <theora/theoradec.h>
+#include <ogg/ogg.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Plays back recordings of ogg_saver as theora_image_transport::Packet messages. The file is
+// memory mapped, and ogg_sync walks it in place: its buffer is pointed into the mapping instead
+// of having the data copied in. ogg_sync_pageseek briefly clears the checksum of each page to
+// verify it, so the mapping is private and writable.
+//
+// The logical bitstreams of each link are published in the order they appear, the first on
+// "stream" and the others on "stream_1", "stream_2" and so on. Packets are stamped with the
+// recorded stamps of the keyframe index when there is one, interpolated between keyframes by
+// frame number, and with the time since the start of the stream otherwise.
+class OggPlayer
+{
+public:
+  OggPlayer()
+   : map_(NULL), size_(0), window_start_(0), start_offset_(0), seek_offset_(0), data_seen_(false),
+     link_streams_(0)
+  {
+    memset(&sync_, 0, sizeof(sync_));
+    ros::NodeHandle local_nh("~");
+    local_nh.param("rate", rate_, 1.0); // Multiple of the recorded rate, 0 for as fast as possible
+    local_nh.param("start", start_, 0.0); // Seconds after the first keyframe, needs the index
+    local_nh.param("loop", loop_, false);
+    local_nh.param("wait_for_subscribers", wait_for_subscribers_, true);
+  }
+
+  ~OggPlayer()
+  {
+    streams_.clear();
+    // ogg_sync_clear would free the mapping
+    if (map_)
+      munmap(map_, size_);
+  }
+
+  bool open(const std::string& filename)
+  {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      ROS_ERROR("Unable to open %s: %s", filename.c_str(), strerror(errno));
+      return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || file_stat.st_size == 0) {
+      ROS_ERROR("%s is empty", filename.c_str());
+      close(fd);
+      return false;
+    }
+    size_ = file_stat.st_size;
+    void* map = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      ROS_ERROR("Unable to map %s: %s", filename.c_str(), strerror(errno));
+      return false;
+    }
+    map_ = (unsigned char*)map;
+    madvise(map_, size_, MADV_SEQUENTIAL);
+
+    if (index_.load(filename)) {
+      for (size_t i = 0; i < index_.entries().size(); i++)
+        keyframes_[index_.entries()[i].serial].push_back(index_.entries()[i]);
+    }
+    return true;
+  }
+
+  void play()
+  {
+    do {
+      startPlayback();
+      ogg_page page;
+      size_t offset;
+      while (ros::ok() && nextPage(page, offset))
+        processPage(page, offset);
+    } while (ros::ok() && loop_);
+    // Give the last messages time to go out
+    ros::WallDuration(0.5).sleep();
+  }
+
+private:
+
+  // A logical bitstream of the current link
+  struct Stream
+  {
+    Stream() : setup(NULL), headers(0), started(false), packet_offset(0), frame(-1), anchor_frame(0), frame_rate(0.0)
+    {
+      th_info_init(&info);
+      th_comment_init(&comment);
+    }
+    ~Stream()
+    {
+      th_setup_free(setup);
+      th_comment_clear(&comment);
+      th_info_clear(&info);
+      ogg_stream_clear(&stream_state);
+    }
+    ogg_stream_state stream_state;
+    ros::Publisher pub;
+    th_info info;
+    th_comment comment;
+    th_setup_info* setup;
+    int headers;
+    bool started; // Got its first keyframe
+    size_t packet_offset; // Of the page the next packet starts in
+    ogg_int64_t frame; // Number of the last packet's frame
+    ros::Time anchor_stamp; // The stamp of anchor_frame, which frame_rate counts on from
+    ogg_int64_t anchor_frame;
+    double frame_rate;
+  };
+  typedef boost::shared_ptr<Stream> StreamPtr;
+
+  unsigned char* map_;
+  size_t size_;
+  ogg_sync_state sync_;
+  size_t window_start_; // Offset of sync_.data in the file
+
+  ros::NodeHandle nh_;
+  std::vector<ros::Publisher> pubs_;
+  std::map<int, StreamPtr> streams_; // By serial number
+  theora_image_transport::KeyframeIndex index_;
+  std::map<ogg_uint32_t, std::vector<theora_image_transport::KeyframeIndexEntry> > keyframes_; // By serial number
+
+  double rate_;
+  double start_;
+  bool loop_;
+  bool wait_for_subscribers_;
+  size_t start_offset_; // Where playback starts, the headers of the link to seek in
+  size_t seek_offset_; // Keyframes to jump to once the headers are read, 0 for none
+  bool data_seen_; // Since the last beginning of stream, so the next one starts a new link
+  int link_streams_;
+
+  // Pacing
+  ros::Time base_stamp_;
+  ros::WallTime base_time_;
+  ros::Time last_stamp_; // Latest stamp paced so far
+
+  static ogg_int64_t granuleFrame(const th_info& info, ogg_int64_t granulepos)
+  {
+    // As th_granule_frame computes it, without a decoder. Since bitstream version 3.2.1 the
+    // granule position counts frames from 1.
+    if (granulepos < 0)
+      return -1;
+    ogg_int64_t iframe = granulepos >> info.keyframe_granule_shift;
+    ogg_int64_t pframe = granulepos - (iframe << info.keyframe_granule_shift);
+    int version = (info.version_major << 16) | (info.version_minor << 8) | info.version_subminor;
+    return iframe + pframe - (version >= 0x030201 ? 1 : 0);
+  }
+
+  static bool offsetLess(const theora_image_transport::KeyframeIndexEntry& entry, size_t offset)
+  {
+    return entry.offset < offset;
+  }
+
+  void setWindow(size_t start)
+  {
+    // ogg_sync counts in ints, so large files are walked in windows of 1 GiB
+    const size_t window_size = 1 << 30;
+    window_start_ = start;
+    sync_.data = map_ + start;
+    sync_.storage = sync_.fill = (int)std::min(size_ - start, window_size);
+    sync_.returned = sync_.unsynced = sync_.headerbytes = sync_.bodybytes = 0;
+  }
+
+  bool nextPage(ogg_page& page, size_t& offset)
+  {
+    for (;;) {
+      long bytes = ogg_sync_pageseek(&sync_, &page);
+      if (bytes > 0) {
+        offset = window_start_ + sync_.returned - bytes;
+        return true;
+      }
+      if (bytes < 0)
+        continue; // Skipped bytes that aren't a page
+      // The next page continues past the window, if there is more file
+      if (window_start_ + sync_.fill >= size_)
+        return false;
+      setWindow(window_start_ + sync_.returned);
+    }
+  }
+
+  void startPlayback()
+  {
+    streams_.clear();
+    data_seen_ = false;
+    link_streams_ = 0;
+    base_time_ = ros::WallTime();
+    start_offset_ = seek_offset_ = 0;
+
+    if (start_ > 0.0) {
+      if (index_.entries().empty()) {
+        ROS_WARN("Can't start %.1f s into a recording without its keyframe index, starting at the beginning",
+                 start_);
+      }
+      else {
+        // Read the headers of the link holding the target, then jump to the earliest keyframe any
+        // of its streams needs
+        ros::Time target = index_.entries()[0].stamp + ros::Duration(start_);
+        const theora_image_transport::KeyframeIndexEntry* entry = index_.find(target);
+        start_offset_ = entry->header_offset;
+        seek_offset_ = entry->offset;
+        std::map<ogg_uint32_t, std::vector<theora_image_transport::KeyframeIndexEntry> >::const_iterator it;
+        for (it = keyframes_.begin(); it != keyframes_.end(); ++it) {
+          const theora_image_transport::KeyframeIndexEntry* keyframe = index_.find(target, it->first);
+          if (keyframe->header_offset == entry->header_offset)
+            seek_offset_ = std::min(seek_offset_, (size_t)keyframe->offset);
+        }
+      }
+    }
+    setWindow(start_offset_);
+  }
+
+  void processPage(ogg_page& page, size_t offset)
+  {
+    int serial = ogg_page_serialno(&page);
+    if (ogg_page_bos(&page)) {
+      // Beginning of stream pages after data start a new link
+      if (data_seen_) {
+        streams_.clear();
+        link_streams_ = 0;
+        data_seen_ = false;
+      }
+      StreamPtr stream = boost::make_shared<Stream>();
+      ogg_stream_init(&stream->stream_state, serial);
+      if ((int)pubs_.size() <= link_streams_) {
+        char topic[32];
+        if (link_streams_ == 0)
+          snprintf(topic, sizeof(topic), "stream");
+        else
+          snprintf(topic, sizeof(topic), "stream_%d", link_streams_);
+        pubs_.push_back(nh_.advertise<theora_image_transport::Packet>(topic, 100));
+        waitForSubscriber(pubs_.back());
+      }
+      stream->pub = pubs_[link_streams_++];
+      streams_[serial] = stream;
+    }
+    std::map<int, StreamPtr>::iterator it = streams_.find(serial);
+    if (it == streams_.end())
+      return; // Joined the recording mid stream
+    Stream& stream = *it->second;
+
+    if (seek_offset_ > offset && stream.headers == 3 && allHeadersRead()) {
+      // Jump over the data before the keyframes, starting the streams over at the next page
+      for (it = streams_.begin(); it != streams_.end(); ++it)
+        ogg_stream_reset(&it->second->stream_state);
+      setWindow(seek_offset_);
+      seek_offset_ = 0;
+      return;
+    }
+
+    // ogg_saver starts a page with every packet, so packets are found at the offset of their
+    // first page
+    if (!ogg_page_continued(&page))
+      stream.packet_offset = offset;
+    if (ogg_stream_pagein(&stream.stream_state, &page))
+      return;
+    ogg_packet oggpacket;
+    int result;
+    while ((result = ogg_stream_packetout(&stream.stream_state, &oggpacket)) != 0) {
+      if (result > 0)
+        processPacket(stream, oggpacket, stream.packet_offset);
+    }
+  }
+
+  bool allHeadersRead() const
+  {
+    for (std::map<int, StreamPtr>::const_iterator it = streams_.begin(); it != streams_.end(); ++it) {
+      if (it->second->headers < 3)
+        return false;
+    }
+    return true;
+  }
+
+  void processPacket(Stream& stream, ogg_packet& oggpacket, size_t offset)
+  {
+    if (stream.headers < 3) {
+      if (th_decode_headerin(&stream.info, &stream.comment, &stream.setup, &oggpacket) <= 0) {
+        ROS_ERROR("Stream %ld has a bad header, skipping it", (long)stream.stream_state.serialno);
+        stream.headers = 4;
+        return;
+      }
+      stream.headers++;
+      if (stream.info.fps_numerator > 0 && stream.info.fps_denominator > 0)
+        stream.frame_rate = (double)stream.info.fps_numerator / stream.info.fps_denominator;
+      publish(stream, oggpacket, ros::Time());
+      return;
+    }
+    if (stream.headers > 3)
+      return;
+    data_seen_ = true;
+
+    // Granule positions end pages, packets before take the frame after the last
+    stream.frame = oggpacket.granulepos >= 0 ? granuleFrame(stream.info, oggpacket.granulepos) : stream.frame + 1;
+    bool keyframe = th_packet_iskeyframe(&oggpacket) == 1;
+    if (!stream.started) {
+      if (!keyframe)
+        return; // Can't be decoded yet
+      stream.started = true;
+      anchor(stream, offset, true);
+    }
+    else if (keyframe) {
+      anchor(stream, offset, false);
+    }
+
+    ros::Time stamp = stream.anchor_stamp +
+                      ros::Duration(stream.frame_rate > 0.0 ? (stream.frame - stream.anchor_frame) / stream.frame_rate : 0.0);
+    pace(stamp);
+    publish(stream, oggpacket, stamp);
+  }
+
+  // Takes the recorded stamp of the keyframe just read from the index, with the frame rate up to
+  // the next keyframe
+  void anchor(Stream& stream, size_t offset, bool first)
+  {
+    std::vector<theora_image_transport::KeyframeIndexEntry>& keyframes = keyframes_[stream.stream_state.serialno];
+    std::vector<theora_image_transport::KeyframeIndexEntry>::const_iterator it =
+        std::lower_bound(keyframes.begin(), keyframes.end(), offset, offsetLess);
+    if (it != keyframes.end() && it->offset == offset) {
+      stream.anchor_stamp = it->stamp;
+      stream.anchor_frame = stream.frame;
+      if (it + 1 != keyframes.end()) {
+        ogg_int64_t frames = granuleFrame(stream.info, (it + 1)->granulepos) - stream.frame;
+        double seconds = ((it + 1)->stamp - it->stamp).toSec();
+        if (frames > 0 && seconds > 0.0)
+          stream.frame_rate = frames / seconds;
+      }
+    }
+    else if (first && it != keyframes.end() && stream.frame_rate > 0.0) {
+      // A keyframe repeated at the start of a link, count back from the next indexed one
+      double seconds = std::max(granuleFrame(stream.info, it->granulepos) - stream.frame, (ogg_int64_t)0) / stream.frame_rate;
+      stream.anchor_stamp = it->stamp.toSec() > seconds ? it->stamp - ros::Duration(seconds) : ros::Time();
+      stream.anchor_frame = stream.frame;
+    }
+    else if (first) {
+      stream.anchor_stamp = ros::Time();
+      stream.anchor_frame = stream.frame;
+    }
+  }
+
+  void pace(const ros::Time& stamp)
+  {
+    if (rate_ <= 0.0)
+      return;
+    // Start over on the first packet and when stamps jump, e.g. between unindexed links. Streams
+    // interleave with small steps back, which go out right away without moving the schedule.
+    ros::WallTime now = ros::WallTime::now();
+    double step = (stamp - last_stamp_).toSec();
+    if (base_time_.isZero() || step < -1.0 || step > 5.0) {
+      base_stamp_ = stamp;
+      base_time_ = now;
+      last_stamp_ = stamp;
+    }
+    else if (step > 0.0)
+      last_stamp_ = stamp;
+    ros::WallTime due = base_time_ + ros::WallDuration((stamp - base_stamp_).toSec() / rate_);
+    if (now < due)
+      (due - now).sleep();
+  }
+
+  void publish(Stream& stream, const ogg_packet& oggpacket, const ros::Time& stamp)
+  {
+    theora_image_transport::Packet msg;
+    msg.header.stamp = stamp;
+    msg.b_o_s = oggpacket.b_o_s;
+    msg.e_o_s = oggpacket.e_o_s;
+    msg.granulepos = oggpacket.granulepos;
+    msg.packetno = oggpacket.packetno;
+    msg.data.assign(oggpacket.packet, oggpacket.packet + oggpacket.bytes);
+    stream.pub.publish(msg);
+  }
+
+  void waitForSubscriber(const ros::Publisher& pub)
+  {
+    // Packets sent before anybody listens are lost, and decoders need the headers
+    if (!wait_for_subscribers_)
+      return;
+    ROS_INFO("Waiting for a subscriber on %s", pub.getTopic().c_str());
+    while (ros::ok() && pub.getNumSubscribers() == 0)
+      ros::WallDuration(0.1).sleep();
+  }
+};
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "OggPlayer", ros::init_options::AnonymousName);
+
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " inputFile stream:=/theora/image/theora [_rate:=1.0] [_start:=s] [_loop:=false]" << endl;
+    exit(3);
+  }
+
+  OggPlayer player;
+  if (!player.open(argv[1]))
+    exit(1);
+  player.play();
+  return 0;
+}
@@ -35,49 +35,108 @@
 #include <ros/ros.h>
 
 #include <theora_image_transport/Packet.h>
+#include <theora_image_transport/stream_start.h>
+#include <theora_image_transport/ogg_writer.h>
+#include <theora_image_transport/keyframe_index.h>
 
 #include <theora/codec.h>
 #include <theora/theoraenc.h>
 #include <theora/theoradec.h>
 #include <ogg/ogg.h>
 
-#include <fstream>
+#include <boost/make_shared.hpp>
+
+#include <cstdio>
+#include <deque>
 #include <vector>
-#include <boost/scoped_array.hpp>
 
 using namespace std;
 
+// Records any number of theora streams into one Ogg file, each as a logical bitstream with a
+// serial number of its own. Ogg wants the first header page of every logical bitstream before
+// any data, so the streams are started together in a group, called a link here. When a stream
+// joins, changes its headers or the file rotates, the link is ended and a new one started with
+// all streams that have seen a keyframe. Every stream starts the new link with the packets since
+// its last keyframe, so each link decodes on its own; they repeat up to one group of pictures.
 class OggSaver
 {
 public:
-  OggSaver(const char* filename)
-   : fout_(filename, std::ios::out|std::ios::binary)
+  OggSaver(const std::string& filename, const std::vector<std::string>& topics)
+   : filename_(filename), file_index_(0), serial_(0), link_offset_(0), rotate_pending_(false)
   {
-    if (ogg_stream_init(&stream_state_, 0) == -1) {
-      ROS_FATAL("Unable to initialize ogg_stream_state structure");
+    // Recordings can be split into files of a given size (MiB) or duration (seconds), named
+    // <name>_0000.ogv and so on. Each file starts with the stream headers and a keyframe.
+    ros::NodeHandle local_nh("~");
+    double rotate_size;
+    local_nh.param("rotate_size", rotate_size, 0.0);
+    local_nh.param("rotate_duration", rotate_duration_, 0.0);
+    rotate_size_ = (size_t)(rotate_size * (1 << 20));
+    // Packets wait this long (seconds) for the other streams, so that pages follow their stamps
+    local_nh.param("interleave_delay", interleave_delay_, 0.5);
+
+    if (!openFile())
       exit(1);
-    }
 
-    sub_ = nh_.subscribe("stream", 10, &OggSaver::processMsg, this);
+    for (size_t i = 0; i < topics.size(); i++) {
+      TrackPtr track = boost::make_shared<Track>();
+      track->id = i;
+      boost::function<void (const theora_image_transport::PacketConstPtr&)> callback =
+          boost::bind(&OggSaver::processMsg, this, _1, track.get());
+      // Room for the header packets and group of pictures the publisher sends on connecting
+      track->sub = nh_.subscribe<theora_image_transport::Packet>(
+          topics[i], 10 + theora_image_transport::MAX_STREAM_START_PACKETS, callback);
+      tracks_.push_back(track);
+    }
   }
 
   ~OggSaver()
   {
-    ogg_page page;
-    if (ogg_stream_flush(&stream_state_, &page) != 0)
-      writePage(page);
-    fout_.close();
-    ogg_stream_clear(&stream_state_);
+    endLink();
+    // writer_ writes out what is still queued as it goes away
   }
 
 private:
 
+  struct QueuedPacket
+  {
+    theora_image_transport::PacketConstPtr msg;
+    ros::WallTime arrival;
+  };
+
+  // One subscribed stream
+  struct Track
+  {
+    Track() : id(0), header_changed(false), linked(false) {}
+    int id; // Position in tracks_
+    ros::Subscriber sub;
+    std::vector<theora_image_transport::PacketConstPtr> header; // Latest header packets received
+    std::vector<theora_image_transport::PacketConstPtr> link_header; // Those the track was linked with
+    bool header_changed; // The track needs a new logical bitstream
+    std::vector<theora_image_transport::PacketConstPtr> gop; // The last keyframe and the packets since
+    bool linked; // Has a logical bitstream in the current link
+    ogg_stream_state stream_state;
+    theora_image_transport::PacketConstPtr held; // Last video packet, written with e_o_s by endLink()
+    std::deque<QueuedPacket> queue; // Waiting to be interleaved with the other tracks
+  };
+  typedef boost::shared_ptr<Track> TrackPtr;
+
   ros::NodeHandle nh_;
-  ogg_stream_state stream_state_;
-  ofstream fout_;
-  ros::Subscriber sub_;
+  theora_image_transport::OggWriter writer_;
+  theora_image_transport::KeyframeIndexWriter index_;
+  std::vector<TrackPtr> tracks_;
+
+  std::string filename_;
+  int file_index_;
+  int serial_; // Next serial number, unique within the recording
+  size_t link_offset_; // Where the headers of the current link start
+  double interleave_delay_;
 
-  // When using this caller is responsible for deleting oggpacket.packet!!
+  size_t rotate_size_;
+  double rotate_duration_;
+  ros::Time file_start_;
+  bool rotate_pending_; // Waiting for a keyframe to start the next file
+
+  // The packet points into msg, which must outlive it. ogg_stream_packetin copies the data.
   void msgToOggPacket(const theora_image_transport::Packet &msg, ogg_packet &oggpacket)
   {
     oggpacket.bytes = msg.data.size();
@@ -85,35 +144,203 @@ private:
     oggpacket.e_o_s = msg.e_o_s;
     oggpacket.granulepos = msg.granulepos;
     oggpacket.packetno = msg.packetno;
-    oggpacket.packet = new unsigned char[oggpacket.bytes];
-    memcpy(oggpacket.packet, &msg.data[0], oggpacket.bytes);
+    oggpacket.packet = msg.data.empty() ? NULL : const_cast<unsigned char*>(&msg.data[0]);
+  }
+
+  bool openFile()
+  {
+    std::string filename = filename_;
+    if (rotate_size_ > 0 || rotate_duration_ > 0.0) {
+      size_t dot = filename_.find_last_of('.');
+      size_t slash = filename_.find_last_of('/');
+      if (dot == std::string::npos || (slash != std::string::npos && slash > dot))
+        dot = filename_.size();
+      char index[16];
+      snprintf(index, sizeof(index), "_%04d", file_index_++);
+      filename = filename_.substr(0, dot) + index + filename_.substr(dot);
+    }
+    file_start_ = ros::Time::now();
+    rotate_pending_ = false;
+    if (!writer_.open(filename))
+      return false;
+    // Recording goes on without an index if it can't be created
+    index_.open(filename);
+    return true;
   }
 
-  void writePage(ogg_page& page)
+  // Every packet gets its pages right away, so that pages of different tracks interleave in the
+  // order of their packets. Only the last video packet of each track is held back, until the track
+  // writes another one or the link ends and it is marked as the end of the stream.
+  void writePacket(Track& track, const theora_image_transport::PacketConstPtr& msg)
   {
-    fout_.write((char*)page.header, page.header_len);
-    fout_.write((char*)page.body,   page.body_len);
+    if (track.held)
+      writePages(track, *track.held, false);
+    track.held = msg;
   }
 
-  void processMsg(const theora_image_transport::PacketConstPtr& message)
+  void writePages(Track& track, const theora_image_transport::Packet& msg, bool e_o_s)
   {
-    /// @todo Make sure we don't write a video packet first
-    /// @todo Handle duplicate headers
-    /// @todo Wait for a keyframe!!
-    /// @todo Need to flush page for initial identification header packet? And after last header packet?
-    /// @todo Handle chaining streams? Need to retroactively set e_o_s on previous video packet.
     ogg_packet oggpacket;
-    msgToOggPacket(*message, oggpacket);
-    boost::scoped_array<unsigned char> packet_guard(oggpacket.packet); // Make sure packet memory gets deleted
+    msgToOggPacket(msg, oggpacket);
+    oggpacket.e_o_s = e_o_s;
 
-    if (ogg_stream_packetin(&stream_state_, &oggpacket)) {
+    // Keyframes start a page, which the index points to. The index writer skips the keyframe a new
+    // link repeats, unless the link starts a new file.
+    if (th_packet_iskeyframe(&oggpacket) == 1) {
+      theora_image_transport::KeyframeIndexEntry entry;
+      entry.offset = writer_.fileSize();
+      entry.header_offset = link_offset_;
+      entry.granulepos = msg.granulepos;
+      entry.stamp = msg.header.stamp;
+      entry.serial = track.stream_state.serialno;
+      index_.append(entry, track.id);
+    }
+
+    if (ogg_stream_packetin(&track.stream_state, &oggpacket)) {
       ROS_ERROR("Error while adding packet to stream.");
       exit(2);
     }
-
     ogg_page page;
-    if (ogg_stream_pageout(&stream_state_, &page) != 0)
-      writePage(page);
+    while (ogg_stream_flush(&track.stream_state, &page))
+      writer_.writePage(page);
+  }
+
+  // Writes the queued packets in stamp order. A packet only waits for tracks without any queued
+  // packets until it is interleave_delay_ old, or not at all with force.
+  void drain(bool force)
+  {
+    ros::WallTime now = ros::WallTime::now();
+    for (;;) {
+      Track* next = NULL;
+      bool waiting = false;
+      for (size_t i = 0; i < tracks_.size(); i++) {
+        Track& track = *tracks_[i];
+        if (!track.linked)
+          continue;
+        if (track.queue.empty())
+          waiting = true;
+        else if (!next || track.queue.front().msg->header.stamp < next->queue.front().msg->header.stamp)
+          next = &track;
+      }
+      if (!next || (waiting && !force && (now - next->queue.front().arrival).toSec() < interleave_delay_))
+        return;
+      writePacket(*next, next->queue.front().msg);
+      next->queue.pop_front();
+    }
+  }
+
+  void endLink()
+  {
+    drain(true);
+    for (size_t i = 0; i < tracks_.size(); i++) {
+      Track& track = *tracks_[i];
+      if (!track.linked)
+        continue;
+      // Every logical bitstream of a link ends with an e_o_s page before the next link starts
+      if (track.held)
+        writePages(track, *track.held, true);
+      track.held.reset();
+      ogg_stream_clear(&track.stream_state);
+      track.linked = false;
+    }
+  }
+
+  void startLink(bool new_file)
+  {
+    endLink();
+    if (new_file && !openFile())
+      exit(1);
+    link_offset_ = writer_.fileSize();
+
+    // All identification headers come first, each on a page of its own. The other headers
+    // end their page before any video.
+    std::vector<Track*> linked;
+    for (size_t i = 0; i < tracks_.size(); i++) {
+      Track& track = *tracks_[i];
+      // A track in the middle of receiving new headers still has the group of pictures of the
+      // old ones, and joins a later link
+      if (track.gop.empty() || track.header.size() < 3)
+        continue;
+      if (ogg_stream_init(&track.stream_state, serial_++) == -1) {
+        ROS_FATAL("Unable to initialize ogg_stream_state structure");
+        exit(1);
+      }
+      track.linked = true;
+      track.link_header = track.header;
+      track.header_changed = false;
+      writePages(track, *track.header[0], false);
+      linked.push_back(&track);
+    }
+    for (size_t i = 0; i < linked.size(); i++) {
+      for (size_t j = 1; j < linked[i]->header.size(); j++)
+        writePages(*linked[i], *linked[i]->header[j], false);
+    }
+
+    // The tracks start over from their last keyframe
+    ros::WallTime now = ros::WallTime::now();
+    for (size_t i = 0; i < linked.size(); i++) {
+      for (size_t j = 0; j < linked[i]->gop.size(); j++) {
+        QueuedPacket queued;
+        queued.msg = linked[i]->gop[j];
+        queued.arrival = now;
+        linked[i]->queue.push_back(queued);
+      }
+    }
+    drain(false);
+  }
+
+  static bool samePackets(const std::vector<theora_image_transport::PacketConstPtr>& a,
+                          const std::vector<theora_image_transport::PacketConstPtr>& b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (size_t i = 0; i < a.size(); i++) {
+      if (a[i]->data != b[i]->data)
+        return false;
+    }
+    return true;
+  }
+
+  void processMsg(const theora_image_transport::PacketConstPtr& message, Track* track)
+  {
+    ogg_packet oggpacket;
+    msgToOggPacket(*message, oggpacket);
+
+    // Collect the headers, which come again whenever a subscriber connects or the publisher
+    // starts a new encoder. The packets since the last keyframe are useless with new ones.
+    if (th_packet_isheader(&oggpacket)) {
+      if (message->b_o_s)
+        track->header.clear();
+      track->header.push_back(message);
+      if (track->header.size() == 3 && !(track->linked && samePackets(track->header, track->link_header))) {
+        track->header_changed = true;
+        track->gop.clear();
+      }
+      return;
+    }
+    if (track->header.size() < 3)
+      return; // Can't decode video without the headers
+
+    bool keyframe = th_packet_iskeyframe(&oggpacket) == 1;
+    if (keyframe)
+      track->gop.clear();
+    else if (track->gop.empty())
+      return; // Nor before the first keyframe
+    track->gop.push_back(message);
+
+    if (!track->linked || track->header_changed || (rotate_pending_ && keyframe)) {
+      startLink(rotate_pending_);
+      return;
+    }
+    QueuedPacket queued;
+    queued.msg = message;
+    queued.arrival = ros::WallTime::now();
+    track->queue.push_back(queued);
+    drain(false);
+
+    if ((rotate_size_ > 0 && writer_.fileSize() >= rotate_size_) ||
+        (rotate_duration_ > 0.0 && (ros::Time::now() - file_start_).toSec() >= rotate_duration_))
+      rotate_pending_ = true;
   }
 };
 
@@ -124,15 +351,20 @@ int main(int argc, char** argv)
   ros::init(argc, argv, "OggSaver", ros::init_options::AnonymousName);
 
   if(argc < 2) {
-    cerr << "Usage: " << argv[0] << " stream:=/theora/image/stream outputFile" << endl;
+    cerr << "Usage: " << argv[0] << " stream:=/theora/image/stream outputFile [_rotate_size:=MiB] [_rotate_duration:=s]" << endl;
+    cerr << "       " << argv[0] << " outputFile /camera1/image/theora /camera2/image/theora ..." << endl;
     exit(3);
   }
-  if (ros::names::remap("stream") == "stream") {
-      ROS_WARN("ogg_saver: stream has not been remapped! Typical command-line usage:\n"
-               "\t$ ./ogg_saver stream:=<theora stream topic> outputFile");
+  std::vector<std::string> topics(argv + 2, argv + argc);
+  if (topics.empty()) {
+    topics.push_back("stream");
+    if (ros::names::remap("stream") == "stream") {
+        ROS_WARN("ogg_saver: stream has not been remapped! Typical command-line usage:\n"
+                 "\t$ ./ogg_saver stream:=<theora stream topic> outputFile");
+    }
   }
   
-  OggSaver saver(argv[1]);
+  OggSaver saver(argv[1], topics);
   
   ros::spin();
   return 0;
@@ -0,0 +1,247 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/ogg_writer.h"
+
+#include <ros/console.h>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace theora_image_transport {
+
+// Seconds a partly filled buffer may wait before the writer thread takes it
+static const double kMaxBufferAge = 1.0;
+
+OggWriter::Buffer::Buffer(size_t capacity)
+  : data(NULL), capacity(capacity), size(0), fd(-1)
+{
+  // Page aligned, so write(2) copies whole pages into the page cache
+  if (posix_memalign((void**)&data, 4096, capacity))
+    throw std::bad_alloc();
+}
+
+OggWriter::Buffer::~Buffer()
+{
+  free(data);
+}
+
+OggWriter::OggWriter(size_t buffer_size, size_t max_buffers, size_t preallocate_size)
+  : buffer_size_(std::max(buffer_size, (size_t)(1 << 16))),
+    max_buffers_(std::max(max_buffers, (size_t)2)),
+    preallocate_size_(preallocate_size),
+    fd_(-1),
+    file_size_(0),
+    stalls_(0),
+    allocated_buffers_(1),
+    stop_(false),
+    writer_fd_(-1),
+    written_(0),
+    reserved_(0)
+{
+  current_ = boost::make_shared<Buffer>(buffer_size_);
+  thread_ = boost::make_shared<boost::thread>(boost::bind(&OggWriter::writerThread, this));
+}
+
+OggWriter::~OggWriter()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    submit(lock);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  thread_->join();
+}
+
+bool OggWriter::open(const std::string& filename)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  // The previous file gets everything written so far, even if that is nothing, so that the
+  // writer thread sees and closes its descriptor
+  submit(lock);
+  file_size_ = 0;
+  fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    ROS_ERROR("Unable to open %s for writing: %s", filename.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void OggWriter::writePage(const ogg_page& page)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (fd_ < 0)
+    return;
+  if (current_->size == 0) {
+    // Starts the writer thread's clock on this buffer
+    current_start_ = ros::WallTime::now();
+    condition_.notify_all();
+  }
+  append(lock, page.header, page.header_len);
+  append(lock, page.body, page.body_len);
+  file_size_ += page.header_len + page.body_len;
+}
+
+void OggWriter::flush()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (current_->size > 0)
+    submit(lock);
+}
+
+void OggWriter::append(boost::mutex::scoped_lock& lock, const unsigned char* data, size_t size)
+{
+  while (size > 0) {
+    size_t n = std::min(size, current_->capacity - current_->size);
+    memcpy(current_->data + current_->size, data, n);
+    current_->size += n;
+    data += n;
+    size -= n;
+    if (current_->size == current_->capacity) {
+      submit(lock);
+      current_start_ = ros::WallTime::now();
+    }
+  }
+}
+
+void OggWriter::submit(boost::mutex::scoped_lock& lock)
+{
+  current_->fd = fd_;
+  queue_.push_back(current_);
+  current_.reset();
+  condition_.notify_all();
+
+  if (free_.empty() && allocated_buffers_ >= max_buffers_) {
+    stalls_++;
+    ROS_WARN_THROTTLE(5.0, "Recording is waiting for the disk, %lu buffers of %lu bytes are queued",
+                      (unsigned long)queue_.size(), (unsigned long)buffer_size_);
+    while (free_.empty())
+      condition_.wait(lock);
+  }
+  if (!free_.empty()) {
+    current_ = free_.back();
+    free_.pop_back();
+    current_->size = 0;
+  }
+  else {
+    allocated_buffers_++;
+    current_ = boost::make_shared<Buffer>(buffer_size_);
+  }
+}
+
+void OggWriter::writerThread()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  for (;;) {
+    if (queue_.empty()) {
+      if (stop_)
+        break;
+      // Low bitrate streams take a long time to fill a buffer, and would lose it all in a crash.
+      // current_ is missing while submit() waits for a free buffer, but then the queue isn't
+      // empty. With the queue empty, a free buffer or room for a new one is always available.
+      if (!current_ || current_->size == 0) {
+        condition_.wait(lock);
+        continue;
+      }
+      double age = (ros::WallTime::now() - current_start_).toSec();
+      if (age < kMaxBufferAge) {
+        condition_.timed_wait(lock, boost::posix_time::microseconds((long)((kMaxBufferAge - age) * 1e6) + 1));
+        continue;
+      }
+      submit(lock);
+      continue;
+    }
+    BufferPtr buffer = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+    writeBuffer(*buffer);
+    lock.lock();
+    free_.push_back(buffer);
+    condition_.notify_all();
+  }
+  if (writer_fd_ >= 0)
+    ::close(writer_fd_);
+}
+
+void OggWriter::writeBuffer(const Buffer& buffer)
+{
+  if (buffer.fd != writer_fd_) {
+    if (writer_fd_ >= 0)
+      ::close(writer_fd_);
+    writer_fd_ = buffer.fd;
+    written_ = reserved_ = 0;
+  }
+  if (writer_fd_ < 0)
+    return;
+
+#ifdef __linux__
+  // Reserve space well ahead of the data, so the file system can hand out large extents.
+  // FALLOC_FL_KEEP_SIZE leaves the file size alone, so an interrupted recording doesn't end in
+  // zeros. File systems without fallocate simply go without.
+  if (preallocate_size_ > 0 && written_ + buffer.size > reserved_) {
+    size_t size = std::max(preallocate_size_, buffer.size);
+    if (fallocate(writer_fd_, FALLOC_FL_KEEP_SIZE, written_, size) == 0)
+      reserved_ = written_ + size;
+    else
+      reserved_ = (size_t)-1;
+  }
+#endif
+
+  const unsigned char* data = buffer.data;
+  size_t size = buffer.size;
+  while (size > 0) {
+    ssize_t n = ::write(writer_fd_, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ROS_ERROR_THROTTLE(5.0, "Failed to write recording: %s", strerror(errno));
+      return;
+    }
+    data += n;
+    size -= n;
+    written_ += n;
+  }
+}
+
+} //namespace theora_image_transport
@@ -33,11 +33,18 @@
 *********************************************************************/
 
 #include "theora_image_transport/theora_publisher.h"
+#include "theora_image_transport/stream_start.h"
+#include "theora_image_transport/color_conversion.h"
+#include "theora_image_transport/frame_difference.h"
 #include <sensor_msgs/image_encodings.h>
 #include <std_msgs/Header.h>
 
 #include <vector>
+#include <algorithm>
 #include <cstdio> //for memcpy
+#include <cmath>
+
+#include <boost/make_shared.hpp>
 
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -45,28 +52,72 @@ using namespace std;
 
 namespace theora_image_transport {
 
-TheoraPublisher::TheoraPublisher()
+static void freeContext(th_enc_ctx* context)
+{
+  if (context) th_encode_free(context);
+}
+
+static void publishPacket(const ros::Publisher& pub, const theora_image_transport::Packet& msg)
+{
+  pub.publish(msg);
+}
+
+TheoraPublisher::Stream::Stream()
 {
   // Initialize info structure fields that don't change
-  th_info_init(&encoder_setup_);
+  th_info_init(&setup);
   
-  encoder_setup_.pic_x = 0;
-  encoder_setup_.pic_y = 0;
-  encoder_setup_.colorspace = TH_CS_UNSPECIFIED;
-  encoder_setup_.pixel_fmt = TH_PF_420; // See bottom of http://www.theora.org/doc/libtheora-1.1beta1/codec_8h.html
-  encoder_setup_.aspect_numerator = 1;
-  encoder_setup_.aspect_denominator = 1;
-  encoder_setup_.fps_numerator = 1; // don't know the frame rate ahead of time
-  encoder_setup_.fps_denominator = 1;
-  encoder_setup_.keyframe_granule_shift = 6; // A good default for streaming applications
+  setup.pic_x = 0;
+  setup.pic_y = 0;
+  setup.colorspace = TH_CS_UNSPECIFIED;
+  // See bottom of http://www.theora.org/doc/libtheora-1.1beta1/codec_8h.html; pixel_format may select 4:2:2
+  setup.pixel_fmt = TH_PF_420;
+  setup.aspect_numerator = 1;
+  setup.aspect_denominator = 1;
+  setup.fps_numerator = 1; // don't know the frame rate ahead of time
+  setup.fps_denominator = 1;
+  setup.keyframe_granule_shift = 6; // A good default for streaming applications
   // Note: target_bitrate and quality set to correct values in configCb
-  encoder_setup_.target_bitrate = -1;
-  encoder_setup_.quality = -1;
+  setup.target_bitrate = -1;
+  setup.quality = -1;
+
+  force_keyframe = false;
+}
+
+TheoraPublisher::Stream::~Stream()
+{
+  context.reset(); // Before the setup it was made from
+  th_info_clear(&setup);
+}
+
+TheoraPublisher::TheoraPublisher()
+  : gop_cache_enabled_(true),
+    context_cache_size_(2),
+    advertise_queue_size_(0),
+    speed_level_config_(-1),
+    encode_time_budget_(0.8),
+    speed_level_(0),
+    speed_level_max_(0),
+    encode_time_(0.0),
+    frame_interval_(0.0),
+    frames_since_speed_change_(0),
+    frame_rate_(0.0),
+    duplicate_threshold_(-1.0),
+    max_duplicate_run_(8),
+    encoder_running_(false),
+    stop_encoder_(false),
+    queue_size_(2),
+    drop_policy_(theora_image_transport::TheoraPublisher_DropOldest),
+    pixel_fmt_(TH_PF_420),
+    encoded_frames_(0),
+    dropped_frames_(0),
+    max_queue_depth_(0)
+{
 }
 
 TheoraPublisher::~TheoraPublisher()
 {
-  th_info_clear(&encoder_setup_);
+  stopEncoderThread();
 }
 
 void TheoraPublisher::advertiseImpl(ros::NodeHandle &nh, const std::string &base_topic, uint32_t queue_size,
@@ -74,13 +125,21 @@ void TheoraPublisher::advertiseImpl(ros::NodeHandle &nh, const std::string &base
                                     const image_transport::SubscriberStatusCallback  &user_disconnect_cb,
                                     const ros::VoidPtr &tracked_object, bool latch)
 {
-  // queue_size doesn't account for the 3 header packets, so we correct (with a little extra) here.
-  queue_size += 4;
+  // queue_size doesn't account for the header packets and the replayed group of pictures, so we
+  // correct (with a little extra) here.
+  queue_size += MAX_STREAM_START_PACKETS + 1;
   // Latching doesn't make a lot of sense with this transport. Could try to save the last keyframe,
   // but do you then send all following delta frames too?
   latch = false;
   typedef image_transport::SimplePublisherPlugin<theora_image_transport::Packet> Base;
   Base::advertiseImpl(nh, base_topic, queue_size, user_connect_cb, user_disconnect_cb, tracked_object, latch);
+  ros::NodeHandle transport_nh(this->nh());
+  status_pub_ = transport_nh.advertise<theora_image_transport::EncoderStatus>("encoder_status", 1);
+
+  // Substreams are advertised from configCb
+  advertise_nh_ = nh;
+  base_topic_ = base_topic;
+  advertise_queue_size_ = queue_size;
 
   // Set up reconfigure server for this topic
   reconfigure_server_ = boost::make_shared<ReconfigureServer>(this->nh());
@@ -88,24 +147,88 @@ void TheoraPublisher::advertiseImpl(ros::NodeHandle &nh, const std::string &base
   reconfigure_server_->setCallback(f);
 }
 
+uint32_t TheoraPublisher::getNumSubscribers() const
+{
+  uint32_t count = image_transport::SimplePublisherPlugin<theora_image_transport::Packet>::getNumSubscribers();
+  boost::mutex::scoped_lock lock(substream_mutex_);
+  for (size_t i = 0; i < substreams_.size(); i++)
+    count += substreams_[i]->pub.getNumSubscribers();
+  return count;
+}
+
+void TheoraPublisher::shutdown()
+{
+  // Encode whatever is still queued, held back duplicates included, while the publisher is valid
+  stopEncoderThread();
+  {
+    boost::mutex::scoped_lock lock(encoder_mutex_);
+    flushDuplicates();
+    boost::mutex::scoped_lock substream_lock(substream_mutex_);
+    substreams_.clear();
+  }
+  status_pub_.shutdown();
+  image_transport::SimplePublisherPlugin<theora_image_transport::Packet>::shutdown();
+}
+
 void TheoraPublisher::configCb(Config& config, uint32_t level)
 {
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    queue_size_ = config.encoder_queue_size;
+    drop_policy_ = config.drop_policy;
+    // Takes effect with the next frame, which then gets a new encoding context
+    pixel_fmt_ = config.pixel_format == theora_image_transport::TheoraPublisher_YCbCr422 ? TH_PF_422 : TH_PF_420;
+  }
+  if (config.async_encoding)
+    startEncoderThread();
+  else
+    stopEncoderThread();
+
+  boost::mutex::scoped_lock lock(encoder_mutex_);
   // target_bitrate must be 0 if we're using quality.
   long bitrate = 0;
   if (config.optimize_for == theora_image_transport::TheoraPublisher_Bitrate)
     bitrate = config.target_bitrate;
-  bool update_bitrate = bitrate && encoder_setup_.target_bitrate != bitrate;
-  bool update_quality = !bitrate && ((encoder_setup_.quality != config.quality) || encoder_setup_.target_bitrate > 0);
-  encoder_setup_.quality = config.quality;
-  encoder_setup_.target_bitrate = bitrate;
+  bool update_bitrate = bitrate && stream_.setup.target_bitrate != bitrate;
+  bool update_quality = !bitrate && ((stream_.setup.quality != config.quality) || stream_.setup.target_bitrate > 0);
+  stream_.setup.quality = config.quality;
+  stream_.setup.target_bitrate = bitrate;
   keyframe_frequency_ = config.keyframe_frequency;
+  gop_cache_enabled_ = config.gop_cache;
+  speed_level_config_ = config.speed_level;
+  encode_time_budget_ = config.encode_time_budget;
+  duplicate_threshold_ = config.duplicate_threshold;
+  max_duplicate_run_ = config.max_duplicate_run;
+  context_cache_size_ = config.context_cache_size;
+
+  // Substreams get the same settings, with the bitrate scaled to their area. They simply start
+  // over with a new context when quality or bitrate change.
+  updateSubstreams(config);
+  for (size_t i = 0; i < substreams_.size(); i++) {
+    Stream& stream = substreams_[i]->stream;
+    stream.setup.quality = config.quality;
+    stream.setup.target_bitrate = bitrate ? std::max(bitrate >> (2 * substreams_[i]->level), 1L) : 0;
+    if (update_bitrate || update_quality)
+      stream.context.reset();
+    else if (stream.context)
+      updateKeyframeFrequency(stream);
+  }
+  // Cached contexts keep the quality and bitrate they were set up with
+  trimContextCache(stream_, update_bitrate || update_quality ? 0 : context_cache_size_);
+  for (size_t i = 0; i < substreams_.size(); i++)
+    trimContextCache(substreams_[i]->stream, update_bitrate || update_quality ? 0 : context_cache_size_);
+  if (!gop_cache_enabled_) {
+    stream_.gop_cache.clear();
+    for (size_t i = 0; i < substreams_.size(); i++)
+      substreams_[i]->stream.gop_cache.clear();
+  }
   
-  if (encoding_context_) {
+  if (stream_.context) {
     int err = 0;
     // libtheora 1.1 lets us change quality or bitrate on the fly, 1.0 does not.
 #ifdef TH_ENCCTL_SET_BITRATE
     if (update_bitrate) {
-      err = th_encode_ctl(encoding_context_.get(), TH_ENCCTL_SET_BITRATE, &bitrate, sizeof(long));
+      err = th_encode_ctl(stream_.context.get(), TH_ENCCTL_SET_BITRATE, &bitrate, sizeof(long));
       if (err)
         ROS_ERROR("Failed to update bitrate dynamically");
     }
@@ -115,7 +238,7 @@ void TheoraPublisher::configCb(Config& config, uint32_t level)
 
 #ifdef TH_ENCCTL_SET_QUALITY
     if (update_quality) {
-      err = th_encode_ctl(encoding_context_.get(), TH_ENCCTL_SET_QUALITY, &config.quality, sizeof(int));
+      err = th_encode_ctl(stream_.context.get(), TH_ENCCTL_SET_QUALITY, &config.quality, sizeof(int));
       // In 1.1 above call will fail if a bitrate has previously been set. That restriction may
       // be relaxed in a future version. Complain on other failures.
       if (err && err != TH_EINVAL)
@@ -127,25 +250,78 @@ void TheoraPublisher::configCb(Config& config, uint32_t level)
 
     // If unable to change parameters dynamically, just create a new encoding context.
     if (err) {
-      encoding_context_.reset();
+      flushDuplicates();
+      stream_.context.reset();
     }
     // Otherwise, do the easy updates and keep going!
     else {
-      updateKeyframeFrequency();
+      updateKeyframeFrequency(stream_);
       config.keyframe_frequency = keyframe_frequency_; // In case desired value was unattainable
+      if (speed_level_config_ >= 0) {
+        setSpeedLevel(speed_level_config_);
+        config.speed_level = speed_level_;
+      }
     }
   }
 }
 
-void TheoraPublisher::connectCallback(const ros::SingleSubscriberPublisher& pub)
+void TheoraPublisher::updateSubstreams(const Config& config)
+{
+  static const char* suffixes[] = {"", "_half", "_quarter"};
+  const bool wanted[] = {false, config.half_resolution_stream, config.quarter_resolution_stream};
+  std::vector<SubstreamPtr> substreams;
+  for (int level = 1; level <= 2; level++) {
+    if (!wanted[level])
+      continue;
+    SubstreamPtr substream;
+    for (size_t i = 0; i < substreams_.size(); i++) {
+      if (substreams_[i]->level == level)
+        substream = substreams_[i];
+    }
+    if (!substream) {
+      // Advertised where image_transport looks for the theora transport of <base topic>_half
+      substream = boost::make_shared<Substream>();
+      substream->level = level;
+      std::string topic = base_topic_ + suffixes[level] + "/" + getTransportName();
+      ros::SubscriberStatusCallback connect_cb = boost::bind(&TheoraPublisher::substreamConnectCallback, this, _1,
+                                                             boost::weak_ptr<Substream>(substream));
+      substream->pub = advertise_nh_.advertise<theora_image_transport::Packet>(topic, advertise_queue_size_, connect_cb);
+      substream->publish_fn = boost::bind(&publishPacket, substream->pub, _1);
+    }
+    substreams.push_back(substream);
+  }
+  boost::mutex::scoped_lock lock(substream_mutex_);
+  substreams_.swap(substreams);
+}
+
+void TheoraPublisher::sendStreamStart(const Stream& stream, const ros::SingleSubscriberPublisher& pub) const
 {
-  // Send the header packets to new subscribers
-  for (unsigned int i = 0; i < stream_header_.size(); i++) {
-    pub.publish(stream_header_[i]);
+  // Send the header packets to new subscribers, followed by the current group of pictures so
+  // that they don't have to wait for the next keyframe
+  for (unsigned int i = 0; i < stream.header.size(); i++) {
+    pub.publish(stream.header[i]);
+  }
+  for (unsigned int i = 0; i < stream.gop_cache.size(); i++) {
+    pub.publish(stream.gop_cache[i]);
   }
 }
 
-static void cvToTheoraPlane(cv::Mat& mat, th_img_plane& plane)
+void TheoraPublisher::connectCallback(const ros::SingleSubscriberPublisher& pub)
+{
+  boost::mutex::scoped_lock lock(encoder_mutex_);
+  sendStreamStart(stream_, pub);
+}
+
+void TheoraPublisher::substreamConnectCallback(const ros::SingleSubscriberPublisher& pub,
+                                               const boost::weak_ptr<Substream>& substream)
+{
+  boost::mutex::scoped_lock lock(encoder_mutex_);
+  SubstreamPtr locked = substream.lock();
+  if (locked)
+    sendStreamStart(locked->stream, pub);
+}
+
+static void cvToTheoraPlane(const cv::Mat& mat, th_img_plane& plane)
 {
   plane.width  = mat.cols;
   plane.height = mat.rows;
@@ -155,69 +331,286 @@ static void cvToTheoraPlane(cv::Mat& mat, th_img_plane& plane)
 
 void TheoraPublisher::publish(const sensor_msgs::Image& message, const PublishFn& publish_fn) const
 {
-  if (!ensureEncodingContext(message, publish_fn))
+  FramePtr frame;
+  th_pixel_fmt pixel_fmt;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    pixel_fmt = pixel_fmt_;
+    // A stopping encoder thread finishes the queued frames first, so that frames stay in order
+    while (encoder_running_ && stop_encoder_)
+      queue_condition_.wait(lock);
+
+    if (encoder_running_) {
+      // Take a free frame, or make room according to the drop policy. Frames that do get encoded
+      // always keep their own header, so dropping never shifts timestamps.
+      if (queue_.size() >= queue_size_) {
+        dropped_frames_++;
+        ROS_WARN_THROTTLE(5.0, "[theora] Encoder falling behind, %lu frames dropped so far (queue depth %lu)",
+                          dropped_frames_, (unsigned long)queue_.size());
+        if (drop_policy_ == theora_image_transport::TheoraPublisher_DropNewest)
+          return;
+        frame = queue_.front();
+        queue_.pop_front();
+      }
+      else if (!free_frames_.empty()) {
+        frame = free_frames_.back();
+        free_frames_.pop_back();
+      }
+      else
+        frame = boost::make_shared<Frame>();
+    }
+  }
+
+  if (!frame) {
+    // Synchronous encoding
+    if (!convertFrame(message, pixel_fmt, frame_))
+      return;
+    frame_.publish_fn = publish_fn;
+    frame_.arrival = ros::WallTime::now();
+    boost::mutex::scoped_lock lock(encoder_mutex_);
+    encodeFrame(frame_);
     return;
-  //return;
-  /// @todo fromImage is deprecated
-  /// @todo Optimized gray-scale path, rgb8
-  /// @todo fromImage can throw cv::Exception on bayer encoded images
+  }
+
+  // Convert while the encoder thread works on earlier frames
+  ros::WallTime arrival = ros::WallTime::now();
+  bool converted = convertFrame(message, pixel_fmt, *frame);
+  frame->publish_fn = publish_fn;
+  frame->arrival = arrival;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    if (!converted) {
+      free_frames_.push_back(frame);
+      return;
+    }
+    queue_.push_back(frame);
+    max_queue_depth_ = std::max(max_queue_depth_, queue_.size());
+  }
+  queue_condition_.notify_all();
+}
 
+bool TheoraPublisher::convertFrame(const sensor_msgs::Image& message, th_pixel_fmt pixel_fmt, Frame& frame) const
+{
+  // Common 8 bit encodings are converted straight from the message data into the padded Y'CbCr
+  // planes in a single pass, and Y'CbCr encodings are just rearranged. Anything else goes through
+  // cv_bridge first.
+  PackedFormat format;
+  YuvFormat yuv_format;
+  bool yuv = false;
+  size_t yuv_size = 0;
+  const unsigned char* src = NULL;
+  int src_step = 0;
   cv_bridge::CvImageConstPtr cv_image_ptr;
-  try
+  if (packedFormatFromEncoding(message.encoding, format) &&
+      message.step >= message.width * format.channels &&
+      message.data.size() >= (size_t)message.step * message.height)
   {
-    // conversion necessary
-    cv_image_ptr = cv_bridge::toCvCopy(message, sensor_msgs::image_encodings::BGR8);
+    src = message.data.empty() ? NULL : &message.data[0];
+    src_step = message.step;
   }
-  catch (cv_bridge::Exception& e)
+  else if (yuvFormatFromEncoding(message.encoding, yuv_format) &&
+           (yuv_size = yuvImageSize(yuv_format, message.width, message.height, message.step)) &&
+           message.data.size() >= yuv_size)
   {
-    ROS_ERROR("cv_bridge exception: '%s'", e.what());
-    return;
+    yuv = true;
+    src = &message.data[0];
+    src_step = message.step;
   }
-  catch (cv::Exception& e)
+  else
   {
-    ROS_ERROR("OpenCV exception: '%s'", e.what());
-    return;
+    /// @todo fromImage can throw cv::Exception on bayer encoded images
+    try
+    {
+      // conversion necessary
+      cv_image_ptr = cv_bridge::toCvCopy(message, sensor_msgs::image_encodings::BGR8);
+    }
+    catch (cv_bridge::Exception& e)
+    {
+      ROS_ERROR("cv_bridge exception: '%s'", e.what());
+      return false;
+    }
+    catch (cv::Exception& e)
+    {
+      ROS_ERROR("OpenCV exception: '%s'", e.what());
+      return false;
+    }
+
+    if (cv_image_ptr == 0) {
+      ROS_ERROR("Unable to convert from '%s' to 'bgr8'", message.encoding.c_str());
+      return false;
+    }
+
+    packedFormatFromEncoding(sensor_msgs::image_encodings::BGR8, format);
+    src = cv_image_ptr->image.data;
+    src_step = cv_image_ptr->image.step;
   }
 
-  if (cv_image_ptr == 0) {
-    ROS_ERROR("Unable to convert from '%s' to 'bgr8'", message.encoding.c_str());
-    return;
+  // Theora has a divisible-by-sixteen restriction for the encoded frame size, so the planes are
+  // allocated at the picture size rounded up to the nearest multiple of 16. Every luma row then
+  // starts 16 byte aligned. The planes are reused while the size is unchanged and the padding
+  // stays black; only the row and column next to an odd sized picture get written again.
+  allocateFrame(frame, message.width, message.height, pixel_fmt);
+  // Mono images only fill the luma plane. Chroma is reset once when the frame last held color.
+  const bool mono = !yuv && src && format.channels == 1;
+  if (mono && !frame.neutral_chroma) {
+    frame.cb.setTo(128);
+    frame.cr.setTo(128);
   }
+  frame.neutral_chroma = mono;
+  frame.header = message.header;
+  frame.width = message.width;
+  frame.height = message.height;
+  frame.pixel_fmt = pixel_fmt;
+  frame.encoding = message.encoding;
 
-  const cv::Mat bgr = cv_image_ptr->image;
+  th_ycbcr_buffer ycbcr_buffer;
+  cvToTheoraPlane(frame.y,  ycbcr_buffer[0]);
+  cvToTheoraPlane(frame.cb, ycbcr_buffer[1]);
+  cvToTheoraPlane(frame.cr, ycbcr_buffer[2]);
+  if (yuv)
+    yuvToYCbCr(src, src_step, message.width, message.height, yuv_format, pixel_fmt, ycbcr_buffer);
+  else if (src)
+    packedToYCbCr(src, src_step, message.width, message.height, format, pixel_fmt, ycbcr_buffer);
+  return true;
+}
 
-  cv::Mat bgr_padded;
-  int frame_width = encoder_setup_.frame_width, frame_height = encoder_setup_.frame_height;
-  if (frame_width == bgr.cols && frame_height == bgr.rows) {
-    bgr_padded = bgr;
+void TheoraPublisher::allocateFrame(Frame& frame, int width, int height, th_pixel_fmt pixel_fmt) const
+{
+  int frame_width = (width + 15) & ~0xF, frame_height = (height + 15) & ~0xF;
+  int chroma_height = pixel_fmt == TH_PF_422 ? frame_height : frame_height / 2;
+  if (frame.y.cols != frame_width || frame.y.rows != frame_height || frame.cb.rows != chroma_height) {
+    frame.y.create(frame_height, frame_width, CV_8UC1);
+    frame.cb.create(chroma_height, frame_width / 2, CV_8UC1);
+    frame.cr.create(chroma_height, frame_width / 2, CV_8UC1);
+    frame.y.setTo(0);
+    frame.cb.setTo(128);
+    frame.cr.setTo(128);
+    frame.neutral_chroma = true;
   }
-  else {
-    bgr_padded = cv::Mat::zeros(frame_height, frame_width, bgr.type());
-    cv::Mat pic_roi = bgr_padded(cv::Rect(0, 0, bgr.cols, bgr.rows));
-    bgr.copyTo(pic_roi);
+}
+
+void TheoraPublisher::halveFrame(const Frame& src, Frame& dst) const
+{
+  // The padded source planes always cover twice the padded picture of the result, except for
+  // padding columns and rows of the result, which then stay black
+  allocateFrame(dst, (src.width + 1) / 2, (src.height + 1) / 2, src.pixel_fmt);
+  halvePlane(src.y.data, src.y.step, std::min(dst.y.cols, src.y.cols / 2), std::min(dst.y.rows, src.y.rows / 2),
+             dst.y.data, dst.y.step);
+  halvePlane(src.cb.data, src.cb.step, std::min(dst.cb.cols, src.cb.cols / 2), std::min(dst.cb.rows, src.cb.rows / 2),
+             dst.cb.data, dst.cb.step);
+  halvePlane(src.cr.data, src.cr.step, std::min(dst.cr.cols, src.cr.cols / 2), std::min(dst.cr.rows, src.cr.rows / 2),
+             dst.cr.data, dst.cr.step);
+  dst.neutral_chroma = false;
+  dst.header = src.header;
+  dst.width = (src.width + 1) / 2;
+  dst.height = (src.height + 1) / 2;
+  dst.pixel_fmt = src.pixel_fmt;
+  dst.encoding = src.encoding;
+  dst.arrival = src.arrival;
+}
+
+void TheoraPublisher::encodeFrame(const Frame& frame) const
+{
+  updateFrameRate(frame);
+
+  // Substreams count towards the encode time, as they share the encoder's time budget
+  ros::WallTime start = ros::WallTime::now();
+  encodeSubstreams(frame);
+  // With substreams, frames also arrive while nobody listens to the full resolution stream
+  if (substreams_.empty() ||
+      image_transport::SimplePublisherPlugin<theora_image_transport::Packet>::getNumSubscribers() > 0)
+    encodeMainStream(frame);
+  adaptSpeedLevel((ros::WallTime::now() - start).toSec(), frame.arrival);
+}
+
+void TheoraPublisher::encodeSubstreams(const Frame& frame) const
+{
+  // Halve the frame only as often as the smallest substream with subscribers needs
+  int levels = 0;
+  for (size_t i = 0; i < substreams_.size(); i++) {
+    if (substreams_[i]->pub.getNumSubscribers() > 0)
+      levels = std::max(levels, substreams_[i]->level);
+  }
+  if ((int)pyramid_.size() < levels)
+    pyramid_.resize(levels);
+  for (int i = 0; i < levels; i++)
+    halveFrame(i == 0 ? frame : pyramid_[i - 1], pyramid_[i]);
+
+  for (size_t i = 0; i < substreams_.size(); i++) {
+    Substream& substream = *substreams_[i];
+    if (substream.level > levels || substream.pub.getNumSubscribers() == 0)
+      continue;
+    const Frame& scaled = pyramid_[substream.level - 1];
+    if (ensureEncodingContext(substream.stream, scaled, substream.publish_fn))
+      submitFrame(substream.stream, scaled, &scaled.header, 1, substream.publish_fn);
   }
+}
 
-  // Convert image to Y'CbCr color space used by Theora
-  cv::Mat ycrcb;
-  cv::cvtColor(bgr_padded, ycrcb, cv::COLOR_BGR2YCrCb);
-  
-  // Split channels
-  cv::Mat ycrcb_planes[3];
-  cv::split(ycrcb, ycrcb_planes);
+void TheoraPublisher::encodeMainStream(const Frame& frame) const
+{
+  if (!contextMatches(stream_, frame)) {
+    // Send held back duplicates while their picture is still the reference
+    flushDuplicates();
+    reference_.width = 0;
+  }
+  if (!ensureEncodingContext(stream_, frame, frame.publish_fn))
+    return;
+
+  if (isDuplicate(frame)) {
+    duplicate_headers_.push_back(frame.header);
+    duplicate_publish_fn_ = frame.publish_fn;
+    // A run of duplicates can't span a keyframe boundary
+    if (duplicate_headers_.size() >= std::min((size_t)max_duplicate_run_, (size_t)keyframe_frequency_))
+      flushDuplicates();
+    return;
+  }
+  flushDuplicates();
+
+  submitFrame(stream_, frame, &frame.header, 1, frame.publish_fn);
 
-  // Use Y as-is but subsample chroma channels
-  cv::Mat y = ycrcb_planes[0], cr, cb;
-  cv::pyrDown(ycrcb_planes[1], cr);
-  cv::pyrDown(ycrcb_planes[2], cb);
+  if (duplicate_threshold_ >= 0.0) {
+    frame.y.copyTo(reference_.y);
+    frame.cb.copyTo(reference_.cb);
+    frame.cr.copyTo(reference_.cr);
+    reference_.width = frame.width;
+    reference_.height = frame.height;
+    reference_.pixel_fmt = frame.pixel_fmt;
+  }
+}
 
+void TheoraPublisher::submitFrame(Stream& stream, const Frame& frame, const std_msgs::Header* headers, int count,
+                                  const PublishFn& publish_fn) const
+{
   // Construct Theora image buffer
   th_ycbcr_buffer ycbcr_buffer;
-  cvToTheoraPlane(y,  ycbcr_buffer[0]);
-  cvToTheoraPlane(cb, ycbcr_buffer[1]);
-  cvToTheoraPlane(cr, ycbcr_buffer[2]);
+  cvToTheoraPlane(frame.y,  ycbcr_buffer[0]);
+  cvToTheoraPlane(frame.cb, ycbcr_buffer[1]);
+  cvToTheoraPlane(frame.cr, ycbcr_buffer[2]);
+
+#ifdef TH_ENCCTL_SET_DUP_COUNT
+  // The encoder follows the next frame with this many zero byte duplicate packets
+  if (count > 1) {
+    int dup_count = count - 1;
+    if (th_encode_ctl(stream.context.get(), TH_ENCCTL_SET_DUP_COUNT, &dup_count, sizeof(int))) {
+      ROS_ERROR("Failed to set duplicate count %d", dup_count);
+      count = 1;
+    }
+  }
+#endif
+
+  // libtheora has no call to force a keyframe, but it starts one as soon as the distance to the
+  // last reaches the keyframe frequency
+  if (stream.force_keyframe) {
+    ogg_uint32_t frequency = 1;
+    th_encode_ctl(stream.context.get(), TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE, &frequency, sizeof(ogg_uint32_t));
+  }
 
   // Submit frame to the encoder
-  int rval = th_encode_ycbcr_in(encoding_context_.get(), ycbcr_buffer);
+  int rval = th_encode_ycbcr_in(stream.context.get(), ycbcr_buffer);
+  if (stream.force_keyframe) {
+    stream.force_keyframe = false;
+    updateKeyframeFrequency(stream);
+  }
   if (rval == TH_EFAULT) {
     ROS_ERROR("[theora] EFAULT in submitting uncompressed frame to encoder");
     return;
@@ -229,61 +622,255 @@ void TheoraPublisher::publish(const sensor_msgs::Image& message, const PublishFn
 
   // Retrieve and publish encoded video data packets
   ogg_packet oggpacket;
-  theora_image_transport::Packet output;
-  while ((rval = th_encode_packetout(encoding_context_.get(), 0, &oggpacket)) > 0) {
-    oggPacketToMsg(message.header, oggpacket, output);
-    publish_fn(output);
+  int index = 0;
+  while ((rval = th_encode_packetout(stream.context.get(), 0, &oggpacket)) > 0) {
+    oggPacketToMsg(headers[std::min(index++, count - 1)], oggpacket, stream.packet);
+    publish_fn(stream.packet);
+    if (gop_cache_enabled_)
+      cacheGopPacket(stream, th_packet_iskeyframe(&oggpacket) == 1, stream.packet);
   }
   if (rval == TH_EFAULT)
     ROS_ERROR("[theora] EFAULT in retrieving encoded video data packets");
 }
 
-void freeContext(th_enc_ctx* context)
+bool TheoraPublisher::isDuplicate(const Frame& frame) const
 {
-  if (context) th_encode_free(context);
+#ifdef TH_ENCCTL_SET_DUP_COUNT
+  if (duplicate_threshold_ < 0.0 || reference_.width != frame.width || reference_.height != frame.height ||
+      reference_.pixel_fmt != frame.pixel_fmt || reference_.y.size() != frame.y.size())
+    return false;
+
+  // Compare 16x16 luma blocks and the chroma blocks covering the same pixels
+  const int chroma_block_height = frame.pixel_fmt == TH_PF_422 ? 16 : 8;
+  const unsigned luma_limit = (unsigned)(duplicate_threshold_ * 16 * 16);
+  const unsigned chroma_limit = (unsigned)(duplicate_threshold_ * 8 * chroma_block_height);
+  return blocksWithinLimit(frame.y.data, frame.y.step, reference_.y.data, reference_.y.step,
+                           frame.y.cols, frame.y.rows, 16, 16, luma_limit) &&
+         blocksWithinLimit(frame.cb.data, frame.cb.step, reference_.cb.data, reference_.cb.step,
+                           frame.cb.cols, frame.cb.rows, 8, chroma_block_height, chroma_limit) &&
+         blocksWithinLimit(frame.cr.data, frame.cr.step, reference_.cr.data, reference_.cr.step,
+                           frame.cr.cols, frame.cr.rows, 8, chroma_block_height, chroma_limit);
+#else
+  return false; // libtheora 1.0 can't be told about duplicates
+#endif
+}
+
+void TheoraPublisher::flushDuplicates() const
+{
+  if (duplicate_headers_.empty())
+    return;
+  // The reference frame is encoded once more, standing in for the first duplicate. It costs
+  // next to nothing as it matches the previous frame.
+  if (stream_.context)
+    submitFrame(stream_, reference_, &duplicate_headers_[0], (int)duplicate_headers_.size(), duplicate_publish_fn_);
+  duplicate_headers_.clear();
+}
+
+void TheoraPublisher::startEncoderThread()
+{
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  if (encoder_thread_)
+    return;
+  stop_encoder_ = false;
+  encoder_running_ = true;
+  encoder_thread_ = boost::make_shared<boost::thread>(boost::bind(&TheoraPublisher::encoderThread, this));
+}
+
+void TheoraPublisher::stopEncoderThread()
+{
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    if (!encoder_thread_)
+      return;
+    stop_encoder_ = true;
+  }
+  queue_condition_.notify_all();
+  encoder_thread_->join();
+  encoder_thread_.reset();
+}
+
+void TheoraPublisher::encoderThread()
+{
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  for (;;) {
+    if (queue_.empty()) {
+      if (stop_encoder_)
+        break;
+      queue_condition_.wait(lock);
+      continue;
+    }
+    FramePtr frame = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+    {
+      boost::mutex::scoped_lock encoder_lock(encoder_mutex_);
+      encodeFrame(*frame);
+    }
+    lock.lock();
+    free_frames_.push_back(frame);
+    encoded_frames_++;
+    ROS_DEBUG_THROTTLE(5.0, "[theora] %lu frames encoded, %lu dropped, queue depth %lu (max %lu)",
+                       encoded_frames_, dropped_frames_, (unsigned long)queue_.size(),
+                       (unsigned long)max_queue_depth_);
+
+    ros::WallTime now = ros::WallTime::now();
+    if (status_pub_ && (now - last_status_).toSec() >= 1.0) {
+      last_status_ = now;
+      theora_image_transport::EncoderStatus status;
+      fillEncoderStatus(status);
+      lock.unlock();
+      status_pub_.publish(status);
+      lock.lock();
+    }
+  }
+  encoder_running_ = false;
+  queue_condition_.notify_all();
 }
 
-bool TheoraPublisher::ensureEncodingContext(const sensor_msgs::Image& image, const PublishFn& publish_fn) const
+theora_image_transport::EncoderStatus TheoraPublisher::encoderStatus() const
 {
-  /// @todo Check if encoding has changed
-  if (encoding_context_ && encoder_setup_.pic_width == image.width &&
-      encoder_setup_.pic_height == image.height)
+  theora_image_transport::EncoderStatus status;
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  fillEncoderStatus(status);
+  return status;
+}
+
+void TheoraPublisher::fillEncoderStatus(theora_image_transport::EncoderStatus& status) const
+{
+  status.header.stamp = ros::Time::now();
+  status.encoded_frames = encoded_frames_;
+  status.dropped_frames = dropped_frames_;
+  status.queue_depth = queue_.size();
+  status.max_queue_depth = max_queue_depth_;
+  status.queue_size = queue_size_;
+}
+
+bool TheoraPublisher::contextMatches(const Stream& stream, const Frame& frame) const
+{
+  return stream.context && stream.setup.pic_width == (ogg_uint32_t)frame.width &&
+         stream.setup.pic_height == (ogg_uint32_t)frame.height && stream.setup.pixel_fmt == frame.pixel_fmt &&
+         stream.encoding == frame.encoding && !frameRateDrifted(stream);
+}
+
+bool TheoraPublisher::ensureEncodingContext(Stream& stream, const Frame& frame, const PublishFn& publish_fn) const
+{
+  if (contextMatches(stream, frame))
     return true;
 
+  // Cameras switching between binned and full resolution modes get their previous encoder back
+  cacheContext(stream);
+  if (!restoreContext(stream, frame) && !createContext(stream, frame))
+    return false;
+
+  updateKeyframeFrequency(stream);
+
+  stream.gop_cache.clear();
+
+  // A new context starts at the slowest level, so apply the current one
+  speed_level_max_ = 0;
+#ifdef TH_ENCCTL_GET_SPLEVEL_MAX
+  if (th_encode_ctl(stream.context.get(), TH_ENCCTL_GET_SPLEVEL_MAX, &speed_level_max_, sizeof(int)))
+    speed_level_max_ = 0;
+#endif
+  if (&stream == &stream_)
+    setSpeedLevel(speed_level_config_ >= 0 ? speed_level_config_ : speed_level_);
+  else
+    applySpeedLevel(stream, std::min(speed_level_, speed_level_max_));
+
+  // Stream the header in case anyone is already listening
+  /// @todo Try not to send headers twice to some listeners
+  for (unsigned int i = 0; i < stream.header.size(); i++) {
+    stream.header[i].header = frame.header;
+    publish_fn(stream.header[i]);
+  }
+  return true;
+}
+
+bool TheoraPublisher::createContext(Stream& stream, const Frame& frame) const
+{
   // Theora has a divisible-by-sixteen restriction for the encoded frame size, so
   // scale the picture size up to the nearest multiple of 16 and calculate offsets.
-  encoder_setup_.frame_width = (image.width + 15) & ~0xF;
-  encoder_setup_.frame_height = (image.height + 15) & ~0xF;
-  encoder_setup_.pic_width = image.width;
-  encoder_setup_.pic_height = image.height;
+  stream.setup.frame_width = (frame.width + 15) & ~0xF;
+  stream.setup.frame_height = (frame.height + 15) & ~0xF;
+  stream.setup.pic_width = frame.width;
+  stream.setup.pic_height = frame.height;
+  stream.setup.pixel_fmt = frame.pixel_fmt;
+  if (frame_rate_ > 0.0) {
+    stream.setup.fps_numerator = (ogg_uint32_t)(frame_rate_ * 1000.0 + 0.5);
+    stream.setup.fps_denominator = 1000;
+  }
 
   // Allocate encoding context. Smart pointer ensures that th_encode_free gets called.
-  encoding_context_.reset(th_encode_alloc(&encoder_setup_), freeContext);
-  if (!encoding_context_) {
+  stream.context.reset(th_encode_alloc(&stream.setup), freeContext);
+  if (!stream.context) {
     ROS_ERROR("[theora] Failed to create encoding context");
     return false;
   }
-
-  updateKeyframeFrequency();
+  stream.force_keyframe = false; // The first frame is one anyway
 
   th_comment comment;
   th_comment_init(&comment);
   boost::shared_ptr<th_comment> clear_guard(&comment, th_comment_clear);
-  /// @todo Store image encoding in comment
   comment.vendor = strdup("Willow Garage theora_image_transport");
+  // Lets subscribers restore mono images without expanding them to color
+  stream.encoding = frame.encoding;
+  th_comment_add_tag(&comment, const_cast<char*>("ENCODING"), const_cast<char*>(stream.encoding.c_str()));
 
-  // Construct the header and stream it in case anyone is already listening
-  /// @todo Try not to send headers twice to some listeners
-  stream_header_.clear();
+  // Construct the header, which ensureEncodingContext publishes
+  stream.header.clear();
   ogg_packet oggpacket;
-  while (th_encode_flushheader(encoding_context_.get(), &comment, &oggpacket) > 0) {
-    stream_header_.push_back(theora_image_transport::Packet());
-    oggPacketToMsg(image.header, oggpacket, stream_header_.back());
-    publish_fn(stream_header_.back());
+  while (th_encode_flushheader(stream.context.get(), &comment, &oggpacket) > 0) {
+    stream.header.push_back(theora_image_transport::Packet());
+    oggPacketToMsg(frame.header, oggpacket, stream.header.back());
   }
   return true;
 }
 
+void TheoraPublisher::cacheContext(Stream& stream) const
+{
+  // Contexts set up for another frame rate would only be rebuilt again
+  if (!stream.context || context_cache_size_ == 0 || frameRateDrifted(stream))
+    return;
+  stream.context_cache.push_front(CachedContext());
+  CachedContext& cached = stream.context_cache.front();
+  cached.setup = stream.setup;
+  cached.context.swap(stream.context);
+  cached.header.swap(stream.header);
+  cached.encoding.swap(stream.encoding);
+  trimContextCache(stream, context_cache_size_);
+}
+
+bool TheoraPublisher::restoreContext(Stream& stream, const Frame& frame) const
+{
+  std::list<CachedContext>::iterator it = stream.context_cache.begin();
+  for (; it != stream.context_cache.end(); ++it) {
+    if (it->setup.pic_width == (ogg_uint32_t)frame.width && it->setup.pic_height == (ogg_uint32_t)frame.height &&
+        it->setup.pixel_fmt == frame.pixel_fmt && it->encoding == frame.encoding)
+      break;
+  }
+  if (it == stream.context_cache.end())
+    return false;
+
+  stream.setup = it->setup;
+  stream.context = it->context;
+  stream.header.swap(it->header);
+  stream.encoding.swap(it->encoding);
+  stream.context_cache.erase(it);
+  if (frameRateDrifted(stream)) {
+    stream.context.reset();
+    return false;
+  }
+  // Subscribers reset their decoder on the header, so the next frame they get must be a keyframe
+  stream.force_keyframe = true;
+  return true;
+}
+
+void TheoraPublisher::trimContextCache(Stream& stream, size_t size) const
+{
+  if (stream.context_cache.size() > size)
+    stream.context_cache.resize(size);
+}
+
 void TheoraPublisher::oggPacketToMsg(const std_msgs::Header& header, const ogg_packet &oggpacket,
                                      theora_image_transport::Packet &msg) const
 {
@@ -292,14 +879,15 @@ void TheoraPublisher::oggPacketToMsg(const std_msgs::Header& header, const ogg_p
   msg.e_o_s      = oggpacket.e_o_s;
   msg.granulepos = oggpacket.granulepos;
   msg.packetno   = oggpacket.packetno;
-  msg.data.resize(oggpacket.bytes);
-  memcpy(&msg.data[0], oggpacket.packet, oggpacket.bytes);
+  // Copied straight from the encoder's buffer, without zero filling first. A reused msg keeps its
+  // capacity, so packets don't allocate once the largest has been seen.
+  msg.data.assign(oggpacket.packet, oggpacket.packet + oggpacket.bytes);
 }
 
-void TheoraPublisher::updateKeyframeFrequency() const
+void TheoraPublisher::updateKeyframeFrequency(Stream& stream) const
 {
   ogg_uint32_t desired_frequency = keyframe_frequency_;
-  if (th_encode_ctl(encoding_context_.get(), TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE,
+  if (th_encode_ctl(stream.context.get(), TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE,
                     &keyframe_frequency_, sizeof(ogg_uint32_t)))
     ROS_ERROR("Failed to change keyframe frequency");
   if (keyframe_frequency_ != desired_frequency)
@@ -307,4 +895,102 @@ void TheoraPublisher::updateKeyframeFrequency() const
              desired_frequency, keyframe_frequency_);
 }
 
+void TheoraPublisher::cacheGopPacket(Stream& stream, bool keyframe, const theora_image_transport::Packet& msg) const
+{
+  // Deltas are only useful after their keyframe. The keyframe distance bounds the cache, unless
+  // the frequency was lowered since the last keyframe.
+  if (keyframe)
+    stream.gop_cache.clear();
+  else if (stream.gop_cache.empty() || stream.gop_cache.size() >= keyframe_frequency_) {
+    stream.gop_cache.clear();
+    return;
+  }
+  stream.gop_cache.push_back(msg);
+}
+
+void TheoraPublisher::setSpeedLevel(int level) const
+{
+  level = std::max(0, std::min(level, speed_level_max_));
+  if (!applySpeedLevel(stream_, level))
+    return;
+  for (size_t i = 0; i < substreams_.size(); i++) {
+    if (substreams_[i]->stream.context)
+      applySpeedLevel(substreams_[i]->stream, level);
+  }
+  speed_level_ = level;
+  frames_since_speed_change_ = 0;
+}
+
+bool TheoraPublisher::applySpeedLevel(Stream& stream, int level) const
+{
+#ifdef TH_ENCCTL_SET_SPLEVEL
+  if (th_encode_ctl(stream.context.get(), TH_ENCCTL_SET_SPLEVEL, &level, sizeof(int))) {
+    ROS_ERROR("Failed to set speed level %d", level);
+    return false;
+  }
+#endif
+  return true; // libtheora 1.0 has a single speed, and speed_level_max_ stays 0
+}
+
+void TheoraPublisher::adaptSpeedLevel(double encode_time, const ros::WallTime& arrival) const
+{
+  // Track encode time against the interval between incoming frames
+  const double alpha = 0.1;
+  encode_time_ = encode_time_ > 0.0 ? encode_time_ + alpha * (encode_time - encode_time_) : encode_time;
+  if (!last_arrival_.isZero()) {
+    double interval = (arrival - last_arrival_).toSec();
+    if (interval > 0.0)
+      frame_interval_ = frame_interval_ > 0.0 ? frame_interval_ + alpha * (interval - frame_interval_) : interval;
+  }
+  last_arrival_ = arrival;
+  frames_since_speed_change_++;
+
+  // Give the averages time to settle after each change, then speed up when over budget and slow
+  // down again when comfortably under it
+  const int settle_frames = 30;
+  if (speed_level_config_ >= 0 || frame_interval_ <= 0.0 || frames_since_speed_change_ < settle_frames)
+    return;
+  double budget = encode_time_budget_ * frame_interval_;
+  if (encode_time_ > budget && speed_level_ < speed_level_max_) {
+    setSpeedLevel(speed_level_ + 1);
+    ROS_DEBUG("[theora] Encoding takes %.1f ms of a %.1f ms budget, speed level raised to %d",
+              encode_time_ * 1000.0, budget * 1000.0, speed_level_);
+  }
+  else if (encode_time_ < 0.5 * budget && speed_level_ > 0) {
+    setSpeedLevel(speed_level_ - 1);
+    ROS_DEBUG("[theora] Encoding takes %.1f ms of a %.1f ms budget, speed level lowered to %d",
+              encode_time_ * 1000.0, budget * 1000.0, speed_level_);
+  }
+}
+
+void TheoraPublisher::updateFrameRate(const Frame& frame) const
+{
+  // Header stamps follow the capture rate. Unstamped images fall back to their arrival time.
+  double stamp = frame.header.stamp.isZero() ? frame.arrival.toSec() : frame.header.stamp.toSec();
+  if (!frame_stamps_.empty()) {
+    if (stamp == frame_stamps_.back())
+      return;
+    if (stamp < frame_stamps_.back())
+      frame_stamps_.clear(); // Time jumped back, e.g. a bag started over
+  }
+  frame_stamps_.push_back(stamp);
+
+  // A few intervals already give a usable estimate, so the first context doesn't run at 1 fps for
+  // a whole window. The rate is refined until the window is full.
+  const size_t window = 30, seed = 4; // Frame intervals
+  if (frame_stamps_.size() > window + 1)
+    frame_stamps_.pop_front();
+  if (frame_stamps_.size() > seed)
+    frame_rate_ = (frame_stamps_.size() - 1) / (frame_stamps_.back() - frame_stamps_.front());
+}
+
+bool TheoraPublisher::frameRateDrifted(const Stream& stream) const
+{
+  // Only the rate controller depends on the frame rate, so quality mode keeps its context
+  if (stream.setup.target_bitrate <= 0 || frame_rate_ <= 0.0)
+    return false;
+  double rate = (double)stream.setup.fps_numerator / stream.setup.fps_denominator;
+  return std::fabs(frame_rate_ - rate) > 0.2 * rate;
+}
+
 } //namespace theora_image_transport
@@ -33,10 +33,11 @@
 *********************************************************************/
 
 #include "theora_image_transport/theora_subscriber.h"
-#include <cv_bridge/cv_bridge.h>
+#include "theora_image_transport/stream_start.h"
+#include "theora_image_transport/color_conversion.h"
 #include <sensor_msgs/image_encodings.h>
-#include <opencv2/imgproc/imgproc.hpp>
-#include <boost/scoped_array.hpp>
+#include <boost/make_shared.hpp>
+#include <cstring>
 #include <vector>
 
 using namespace std;
@@ -45,10 +46,19 @@ namespace theora_image_transport {
 
 TheoraSubscriber::TheoraSubscriber()
   : pplevel_(0),
+    output_encoding_(sensor_msgs::image_encodings::BGR8),
     received_header_(false),
     received_keyframe_(false),
+    mono_source_(false),
     decoding_context_(NULL),
-    setup_info_(NULL)
+    setup_info_(NULL),
+    generation_(0),
+    latest_generation_(0),
+    ring_head_(0),
+    ring_count_(0),
+    stop_conversion_(false),
+    conversion_running_(false),
+    conversion_detached_(NULL)
 {
   th_info_init(&header_info_);
   th_comment_init(&header_comment_);
@@ -56,6 +66,7 @@ TheoraSubscriber::TheoraSubscriber()
 
 TheoraSubscriber::~TheoraSubscriber()
 {
+  stopConversionThread();
   if (decoding_context_) th_decode_free(decoding_context_);
   th_setup_free(setup_info_);
   th_info_clear(&header_info_);
@@ -66,8 +77,9 @@ void TheoraSubscriber::subscribeImpl(ros::NodeHandle &nh, const std::string &bas
                                      const Callback &callback, const ros::VoidPtr &tracked_object,
                                      const image_transport::TransportHints &transport_hints)
 {
-  // queue_size doesn't account for the 3 header packets, so we correct (with a little extra) here.
-  queue_size += 4;
+  // queue_size doesn't account for the header packets and the replayed group of pictures, so we
+  // correct (with a little extra) here.
+  queue_size += MAX_STREAM_START_PACKETS + 1;
   typedef image_transport::SimpleSubscriberPlugin<theora_image_transport::Packet> Base;
   Base::subscribeImpl(nh, base_topic, queue_size, callback, tracked_object, transport_hints);
 
@@ -77,8 +89,23 @@ void TheoraSubscriber::subscribeImpl(ros::NodeHandle &nh, const std::string &bas
   reconfigure_server_->setCallback(f);
 }
 
+void TheoraSubscriber::shutdown()
+{
+  // Deliver whatever is still queued while the subscriber is valid
+  stopConversionThread();
+  image_transport::SimpleSubscriberPlugin<theora_image_transport::Packet>::shutdown();
+}
+
 void TheoraSubscriber::configCb(Config& config, uint32_t level)
 {
+  if (config.pipelined_decoding)
+    startConversionThread();
+  else
+    stopConversionThread();
+  {
+    boost::mutex::scoped_lock lock(ring_mutex_);
+    output_encoding_ = config.output_encoding;
+  }
   if (decoding_context_ && pplevel_ != config.post_processing_level) {
     pplevel_ = updatePostProcessingLevel(config.post_processing_level);
     config.post_processing_level = pplevel_; // In case more than PPLEVEL_MAX
@@ -106,7 +133,7 @@ int TheoraSubscriber::updatePostProcessingLevel(int level)
   return level;
 }
 
-//When using this caller is responsible for deleting oggpacket.packet!!
+// The packet points into msg, which must outlive it. libtheora only reads packet data.
 void TheoraSubscriber::msgToOggPacket(const theora_image_transport::Packet &msg, ogg_packet &ogg)
 {
   ogg.bytes      = msg.data.size();
@@ -114,16 +141,13 @@ void TheoraSubscriber::msgToOggPacket(const theora_image_transport::Packet &msg,
   ogg.e_o_s      = msg.e_o_s;
   ogg.granulepos = msg.granulepos;
   ogg.packetno   = msg.packetno;
-  ogg.packet = new unsigned char[ogg.bytes];
-  memcpy(ogg.packet, &msg.data[0], ogg.bytes);
+  ogg.packet     = msg.data.empty() ? NULL : const_cast<unsigned char*>(&msg.data[0]);
 }
 
 void TheoraSubscriber::internalCallback(const theora_image_transport::PacketConstPtr& message, const Callback& callback)
 {
-  /// @todo Break this function into pieces
   ogg_packet oggpacket;
   msgToOggPacket(*message, oggpacket);
-  boost::scoped_array<unsigned char> packet_guard(oggpacket.packet); // Make sure packet memory gets deleted
 
   // Beginning of logical stream flag means we're getting new headers
   if (oggpacket.b_o_s == 1) {
@@ -140,7 +164,7 @@ void TheoraSubscriber::internalCallback(const theora_image_transport::PacketCons
     th_info_init(&header_info_);
     th_comment_clear(&header_comment_);
     th_comment_init(&header_comment_);
-    latest_image_.reset();
+    generation_++; // Duplicates no longer refer to the latest image
   }
 
   // Decode header packets until we get the first video packet
@@ -156,6 +180,10 @@ void TheoraSubscriber::internalCallback(const theora_image_transport::PacketCons
         }
         received_header_ = true;
         pplevel_ = updatePostProcessingLevel(pplevel_);
+        {
+          const char* encoding = th_comment_query(&header_comment_, const_cast<char*>("ENCODING"), 0);
+          mono_source_ = encoding && sensor_msgs::image_encodings::MONO8 == encoding;
+        }
         break; // Continue on the video decoding
       case TH_EFAULT:
         ROS_WARN("[theora] EFAULT when processing header packet");
@@ -188,13 +216,8 @@ void TheoraSubscriber::internalCallback(const theora_image_transport::PacketCons
     case 0:
       break; // Yay, we got a frame. Carry on below.
     case TH_DUPFRAME:
-      // Video data hasn't changed, so we update the timestamp and reuse the last received frame.
       ROS_DEBUG("[theora] Got a duplicate frame");
-      if (latest_image_) {
-        latest_image_->header = message->header;
-        callback(latest_image_);
-      }
-      return;
+      break;
     case TH_EFAULT:
       ROS_WARN("[theora] EFAULT processing video packet");
       return;
@@ -209,35 +232,178 @@ void TheoraSubscriber::internalCallback(const theora_image_transport::PacketCons
       return;
   }
 
-  // We have a new decoded frame available
-  th_ycbcr_buffer ycbcr_buffer;
-  th_decode_ycbcr_out(decoding_context_, ycbcr_buffer);
-
-  // Wrap YCbCr channel data into OpenCV format
-  th_img_plane &y_plane = ycbcr_buffer[0], &cb_plane = ycbcr_buffer[1], &cr_plane = ycbcr_buffer[2];
-  cv::Mat y(y_plane.height, y_plane.width, CV_8UC1, y_plane.data, y_plane.stride);
-  cv::Mat cb_sub(cb_plane.height, cb_plane.width, CV_8UC1, cb_plane.data, cb_plane.stride);
-  cv::Mat cr_sub(cr_plane.height, cr_plane.width, CV_8UC1, cr_plane.data, cr_plane.stride);
-
-  // Upsample chroma channels
-  cv::Mat cb, cr;
-  cv::pyrUp(cb_sub, cb);
-  cv::pyrUp(cr_sub, cr);
-
-  // Merge into interleaved image. Note OpenCV uses YCrCb, so we swap the chroma channels.
-  cv::Mat ycrcb, channels[] = {y, cr, cb};
-  cv::merge(channels, 3, ycrcb);
-
-  // Convert to BGR color
-  cv::Mat bgr, bgr_padded;
-  cv::cvtColor(ycrcb, bgr_padded, CV_YCrCb2BGR);
-  // Pull out original (non-padded) image region
-  bgr = bgr_padded(cv::Rect(header_info_.pic_x, header_info_.pic_y,
-                            header_info_.pic_width, header_info_.pic_height));
-
-  latest_image_ = cv_bridge::CvImage(message->header, sensor_msgs::image_encodings::BGR8, bgr).toImageMsg();
-  /// @todo Handle RGB8 or MONO8 efficiently
-  callback(latest_image_);
+  DecodedFrame frame;
+  frame.header = message->header;
+  frame.generation = generation_;
+  frame.duplicate = rval == TH_DUPFRAME;
+  frame.width = header_info_.pic_width;
+  frame.height = header_info_.pic_height;
+  frame.pic_x = header_info_.pic_x;
+  frame.pic_y = header_info_.pic_y;
+  frame.pixel_fmt = header_info_.pixel_fmt;
+  frame.mono_source = mono_source_;
+  {
+    boost::mutex::scoped_lock lock(ring_mutex_);
+    frame.encoding = output_encoding_;
+  }
+  frame.callback = callback;
+  if (!frame.duplicate)
+    th_decode_ycbcr_out(decoding_context_, frame.planes);
+
+  // Decoding has to stay in order on this thread, conversion may run on the next frame's time
+  queueFrame(frame);
+}
+
+void TheoraSubscriber::queueFrame(const DecodedFrame& frame)
+{
+  {
+    boost::mutex::scoped_lock lock(ring_mutex_);
+    while (conversion_running_ && ring_count_ == ring_.size())
+      ring_condition_.wait(lock);
+    if (conversion_running_) {
+      // The decoder reuses its planes for the next frame, so the picture is copied into the slot
+      DecodedFrame& slot = ring_[(ring_head_ + ring_count_) % ring_.size()];
+      slot.header = frame.header;
+      slot.generation = frame.generation;
+      slot.duplicate = frame.duplicate;
+      slot.width = frame.width;
+      slot.height = frame.height;
+      slot.pic_x = frame.pic_x;
+      slot.pic_y = frame.pic_y;
+      slot.pixel_fmt = frame.pixel_fmt;
+      slot.mono_source = frame.mono_source;
+      slot.encoding = frame.encoding;
+      slot.callback = frame.callback;
+      for (int i = 0; i < 3 && !frame.duplicate; i++) {
+        const th_img_plane& src = frame.planes[i];
+        slot.storage[i].resize((size_t)src.width * src.height);
+        for (int row = 0; row < src.height; row++)
+          memcpy(&slot.storage[i][row * src.width], src.data + row * src.stride, src.width);
+        slot.planes[i].width = src.width;
+        slot.planes[i].height = src.height;
+        slot.planes[i].stride = src.width;
+        slot.planes[i].data = slot.storage[i].empty() ? NULL : &slot.storage[i][0];
+      }
+      ring_count_++;
+      ring_condition_.notify_all();
+      return;
+    }
+  }
+  deliverFrame(frame);
+}
+
+void TheoraSubscriber::deliverFrame(const DecodedFrame& frame)
+{
+  if (frame.duplicate) {
+    // Video data hasn't changed, so we update the timestamp and reuse the last received frame.
+    if (latest_image_ && latest_generation_ == frame.generation) {
+      latest_image_->header = frame.header;
+      frame.callback(latest_image_);
+    }
+    return;
+  }
+
+  // Convert the picture region straight into the output message. Y'CbCr output skips chroma
+  // upsampling and color conversion altogether.
+  sensor_msgs::ImagePtr image = boost::make_shared<sensor_msgs::Image>();
+  image->header = frame.header;
+  image->height = frame.height;
+  image->width = frame.width;
+  image->encoding = frame.encoding;
+  image->is_bigendian = 0;
+
+  PackedFormat format;
+  YuvFormat yuv_format;
+  // Mono sources carry only neutral chroma, so color output would just triple the luma
+  if (frame.mono_source && !yuvFormatFromEncoding(image->encoding, yuv_format))
+    image->encoding = sensor_msgs::image_encodings::MONO8;
+  if (yuvFormatFromEncoding(image->encoding, yuv_format)) {
+    image->step = image->width;
+    image->data.resize(yuvImageSize(yuv_format, image->width, image->height, image->step));
+    if (!image->data.empty())
+      yCbCrToYuv(frame.planes, frame.pixel_fmt, frame.pic_x, frame.pic_y,
+                 image->width, image->height, yuv_format, &image->data[0], image->step);
+  }
+  else {
+    if (!packedFormatFromEncoding(image->encoding, format)) {
+      image->encoding = sensor_msgs::image_encodings::BGR8;
+      packedFormatFromEncoding(image->encoding, format);
+    }
+    image->step = image->width * format.channels;
+    image->data.resize(image->step * image->height);
+    if (!image->data.empty())
+      yCbCrToPacked(frame.planes, frame.pixel_fmt, frame.pic_x, frame.pic_y,
+                    image->width, image->height, format, &image->data[0], image->step);
+  }
+
+  latest_image_ = image;
+  latest_generation_ = frame.generation;
+  frame.callback(latest_image_);
+}
+
+void TheoraSubscriber::startConversionThread()
+{
+  boost::mutex::scoped_lock lock(ring_mutex_);
+  if (conversion_thread_)
+    return;
+  // Three slots let decoding run a frame ahead while the user callback still holds one
+  ring_.resize(3);
+  ring_head_ = ring_count_ = 0;
+  stop_conversion_ = false;
+  conversion_running_ = true;
+  conversion_thread_ = boost::make_shared<boost::thread>(boost::bind(&TheoraSubscriber::conversionThread, this));
+}
+
+void TheoraSubscriber::stopConversionThread()
+{
+  {
+    boost::mutex::scoped_lock lock(ring_mutex_);
+    if (!conversion_thread_)
+      return;
+    if (boost::this_thread::get_id() == conversion_thread_->get_id()) {
+      // Called from the user callback, which may go on to destroy the subscriber. The thread can't
+      // join itself, so it is detached and returns as soon as the callback does, without touching
+      // the subscriber again. Frames still queued are dropped.
+      *conversion_detached_ = true;
+      conversion_thread_->detach();
+      conversion_thread_.reset();
+      ring_count_ = 0;
+      conversion_running_ = false;
+      return;
+    }
+    stop_conversion_ = true;
+  }
+  ring_condition_.notify_all();
+  conversion_thread_->join();
+  conversion_thread_.reset();
+}
+
+void TheoraSubscriber::conversionThread()
+{
+  bool detached = false;
+  boost::mutex::scoped_lock lock(ring_mutex_);
+  conversion_detached_ = &detached;
+  for (;;) {
+    if (ring_count_ == 0) {
+      if (stop_conversion_)
+        break;
+      ring_condition_.wait(lock);
+      continue;
+    }
+    // The slot stays reserved until delivered, the decode stage only writes behind it
+    const DecodedFrame& frame = ring_[ring_head_];
+    lock.unlock();
+    deliverFrame(frame);
+    if (detached)
+      return;
+    lock.lock();
+    ring_head_ = (ring_head_ + 1) % ring_.size();
+    ring_count_--;
+    ring_condition_.notify_all();
+  }
+  // Frames decoded from now on are delivered on the decode thread
+  conversion_running_ = false;
+  ring_condition_.notify_all();
 }
 
 } //namespace theora_image_transport
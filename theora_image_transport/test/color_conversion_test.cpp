@@ -0,0 +1,426 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/color_conversion.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace theora_image_transport;
+
+// Sizes around the 16 pixel SIMD blocks and the 64 pixel strips, most of them odd
+static const int kSizes[][2] = {{1, 1}, {3, 2}, {17, 5}, {45, 31}, {67, 3}, {130, 9}};
+
+// Y'CbCr planes of a frame covering width x height, rounded up to even dimensions, with
+// row padding so that strides differ from widths
+struct Planes
+{
+  std::vector<unsigned char> data[3];
+  th_ycbcr_buffer buffer;
+
+  Planes(int width, int height, th_pixel_fmt pixel_fmt, bool random)
+  {
+    const int frame_width = (width + 1) & ~1, frame_height = (height + 1) & ~1;
+    for (int c = 0; c < 3; c++)
+    {
+      th_img_plane& plane = buffer[c];
+      plane.width = c && pixel_fmt != TH_PF_444 ? frame_width / 2 : frame_width;
+      plane.height = c && pixel_fmt == TH_PF_420 ? frame_height / 2 : frame_height;
+      plane.stride = plane.width + 7;
+      data[c].resize(plane.stride * plane.height, 128);
+      if (random)
+        for (size_t i = 0; i < data[c].size(); i++)
+          data[c][i] = rand();
+      plane.data = &data[c][0];
+    }
+  }
+
+  unsigned char sample(int c, int x, int y, th_pixel_fmt pixel_fmt) const
+  {
+    if (c)
+    {
+      x >>= pixel_fmt != TH_PF_444;
+      y >>= pixel_fmt == TH_PF_420;
+    }
+    return buffer[c].data[y * buffer[c].stride + x];
+  }
+};
+
+static std::vector<unsigned char> randomImage(int step, int height)
+{
+  std::vector<unsigned char> image(step * height);
+  for (size_t i = 0; i < image.size(); i++)
+    image[i] = rand();
+  return image;
+}
+
+// Float full range BT.601, as OpenCV's COLOR_BGR2YCrCb
+static double refLuma(double r, double g, double b)
+{
+  return 0.299 * r + 0.587 * g + 0.114 * b;
+}
+
+static double clamp255(double v)
+{
+  return std::min(255.0, std::max(0.0, v));
+}
+
+// Float inverse, as OpenCV's COLOR_YCrCb2BGR
+static void refRgb(int y, int cb, int cr, double rgb[3])
+{
+  rgb[0] = clamp255(y + 1.403 * (cr - 128));
+  rgb[1] = clamp255(y - 0.714 * (cr - 128) - 0.344 * (cb - 128));
+  rgb[2] = clamp255(y + 1.773 * (cb - 128));
+}
+
+TEST(ColorConversionTest, packedToYCbCrMatchesBt601) {
+  const char* encodings[] = {"bgr8", "rgb8", "bgra8", "rgba8"};
+  const th_pixel_fmt pixel_fmts[] = {TH_PF_420, TH_PF_422};
+  srand(0);
+  for (int e = 0; e < 4; e++)
+  {
+    PackedFormat format;
+    ASSERT_TRUE(packedFormatFromEncoding(encodings[e], format));
+    for (int s = 0; s < 6; s++)
+    {
+      const int width = kSizes[s][0], height = kSizes[s][1], step = width * format.channels + 5;
+      const std::vector<unsigned char> image = randomImage(step, height);
+      for (int f = 0; f < 2; f++)
+      {
+        const th_pixel_fmt pixel_fmt = pixel_fmts[f];
+        Planes planes(width, height, pixel_fmt, false);
+        packedToYCbCr(&image[0], step, width, height, format, pixel_fmt, planes.buffer);
+
+        const int block_height = pixel_fmt == TH_PF_420 ? 2 : 1;
+        for (int y = 0; y < height; y++)
+        {
+          for (int x = 0; x < width; x++)
+          {
+            const unsigned char* p = &image[y * step + x * format.channels];
+            EXPECT_NEAR(refLuma(p[format.r], p[format.g], p[format.b]), planes.sample(0, x, y, pixel_fmt), 1.0)
+                << encodings[e] << " " << width << "x" << height << " at " << x << "," << y;
+          }
+        }
+        // Chroma of each block, with odd edges replicated
+        for (int y = 0; y < height; y += block_height)
+        {
+          for (int x = 0; x < width; x += 2)
+          {
+            double r = 0, b = 0, l = 0;
+            for (int dy = 0; dy < block_height; dy++)
+            {
+              for (int dx = 0; dx < 2; dx++)
+              {
+                const unsigned char* p = &image[std::min(y + dy, height - 1) * step +
+                                                std::min(x + dx, width - 1) * format.channels];
+                r += p[format.r];
+                b += p[format.b];
+                l += refLuma(p[format.r], p[format.g], p[format.b]);
+              }
+            }
+            const double n = 2 * block_height;
+            EXPECT_NEAR(clamp255(128 + 0.564 * (b - l) / n), planes.sample(1, x, y, pixel_fmt), 1.5)
+                << encodings[e] << " " << width << "x" << height << " at " << x << "," << y;
+            EXPECT_NEAR(clamp255(128 + 0.713 * (r - l) / n), planes.sample(2, x, y, pixel_fmt), 1.5)
+                << encodings[e] << " " << width << "x" << height << " at " << x << "," << y;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(ColorConversionTest, packedToYCbCrMono) {
+  PackedFormat format;
+  ASSERT_TRUE(packedFormatFromEncoding("mono8", format));
+  EXPECT_FALSE(packedFormatFromEncoding("mono16", format));
+  const int width = 45, height = 31, step = 48;
+  const std::vector<unsigned char> image = randomImage(step, height);
+  Planes planes(width, height, TH_PF_420, false);
+  packedToYCbCr(&image[0], step, width, height, format, TH_PF_420, planes.buffer);
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      EXPECT_EQ(image[y * step + x], planes.sample(0, x, y, TH_PF_420));
+  // Chroma planes are left alone
+  for (int c = 1; c < 3; c++)
+    EXPECT_EQ(planes.data[c].size(), (size_t)std::count(planes.data[c].begin(), planes.data[c].end(), 128));
+}
+
+TEST(ColorConversionTest, yCbCrToPackedMatchesBt601) {
+  const char* encodings[] = {"bgr8", "rgb8", "bgra8", "rgba8"};
+  const th_pixel_fmt pixel_fmts[] = {TH_PF_420, TH_PF_422, TH_PF_444};
+  srand(0);
+  for (int f = 0; f < 3; f++)
+  {
+    const th_pixel_fmt pixel_fmt = pixel_fmts[f];
+    for (int s = 0; s < 6; s++)
+    {
+      // Odd picture offsets, so that rows start in the middle of a chroma sample
+      const int width = kSizes[s][0], height = kSizes[s][1], pic_x = 3, pic_y = 1;
+      const Planes planes(pic_x + width, pic_y + height, pixel_fmt, true);
+      for (int e = 0; e < 4; e++)
+      {
+        PackedFormat format;
+        ASSERT_TRUE(packedFormatFromEncoding(encodings[e], format));
+        const int step = width * format.channels + 3;
+        std::vector<unsigned char> image(step * height);
+        yCbCrToPacked(planes.buffer, pixel_fmt, pic_x, pic_y, width, height, format, &image[0], step);
+        for (int y = 0; y < height; y++)
+        {
+          for (int x = 0; x < width; x++)
+          {
+            double rgb[3];
+            refRgb(planes.sample(0, pic_x + x, pic_y + y, pixel_fmt), planes.sample(1, pic_x + x, pic_y + y, pixel_fmt),
+                   planes.sample(2, pic_x + x, pic_y + y, pixel_fmt), rgb);
+            const unsigned char* p = &image[y * step + x * format.channels];
+            EXPECT_NEAR(rgb[0], p[format.r], 1.0) << encodings[e] << " at " << x << "," << y;
+            EXPECT_NEAR(rgb[1], p[format.g], 1.0) << encodings[e] << " at " << x << "," << y;
+            EXPECT_NEAR(rgb[2], p[format.b], 1.0) << encodings[e] << " at " << x << "," << y;
+            if (format.channels == 4)
+              EXPECT_EQ(255, p[3]);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(ColorConversionTest, packedRoundTrip) {
+  // Each 2x2 block has a single color, so the chroma subsampling loses nothing and only the
+  // 8 bit quantization of Y'CbCr remains.
+  PackedFormat format;
+  ASSERT_TRUE(packedFormatFromEncoding("bgr8", format));
+  srand(0);
+  for (int s = 0; s < 6; s++)
+  {
+    const int width = kSizes[s][0], height = kSizes[s][1], step = 3 * width;
+    std::vector<unsigned char> image(step * height);
+    for (int y = 0; y < height; y += 2)
+    {
+      for (int x = 0; x < width; x += 2)
+      {
+        const unsigned char color[3] = {(unsigned char)rand(), (unsigned char)rand(), (unsigned char)rand()};
+        for (int dy = 0; dy < 2 && y + dy < height; dy++)
+          for (int dx = 0; dx < 2 && x + dx < width; dx++)
+            std::copy(color, color + 3, &image[(y + dy) * step + 3 * (x + dx)]);
+      }
+    }
+    Planes planes(width, height, TH_PF_420, false);
+    packedToYCbCr(&image[0], step, width, height, format, TH_PF_420, planes.buffer);
+    std::vector<unsigned char> decoded(step * height);
+    yCbCrToPacked(planes.buffer, TH_PF_420, 0, 0, width, height, format, &decoded[0], step);
+    for (size_t i = 0; i < image.size(); i++)
+      EXPECT_NEAR(image[i], decoded[i], 2) << width << "x" << height << " at byte " << i;
+  }
+}
+
+// Builds a Y'CbCr image in the given layout from the luma and 4:2:0 chroma planes
+static std::vector<unsigned char> makeYuvImage(const YuvFormat& format, const Planes& planes, int width,
+                                               int height, int step)
+{
+  std::vector<unsigned char> image(yuvImageSize(format, width, height, step));
+  const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  if (format.layout == YuvFormat::PACKED_422)
+  {
+    // Both luma rows of a 4:2:0 chroma row share its samples
+    for (int y = 0; y < height; y++)
+    {
+      for (int x = 0; x < chroma_width; x++)
+      {
+        unsigned char* p = &image[y * step + 4 * x];
+        p[format.y] = planes.sample(0, 2 * x, y, TH_PF_420);
+        p[format.y + 2] = planes.sample(0, 2 * x + 1, y, TH_PF_420);
+        p[format.cb] = planes.sample(1, 2 * x, y, TH_PF_420);
+        p[format.cr] = planes.sample(2, 2 * x, y, TH_PF_420);
+      }
+    }
+    return image;
+  }
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      image[y * step + x] = planes.sample(0, x, y, TH_PF_420);
+  unsigned char* chroma = &image[step * height];
+  const int chroma_step = format.layout == YuvFormat::PLANAR_420 ? (step + 1) / 2 : step;
+  for (int y = 0; y < chroma_height; y++)
+  {
+    for (int x = 0; x < chroma_width; x++)
+    {
+      for (int c = 1; c < 3; c++)
+      {
+        const int index = c == 1 ? format.cb : format.cr;
+        if (format.layout == YuvFormat::SEMI_PLANAR_420)
+          chroma[y * chroma_step + 2 * x + index] = planes.sample(c, 2 * x, 2 * y, TH_PF_420);
+        else
+          chroma[((index - 1) * chroma_height + y) * chroma_step + x] = planes.sample(c, 2 * x, 2 * y, TH_PF_420);
+      }
+    }
+  }
+  return image;
+}
+
+TEST(ColorConversionTest, yuvLayouts) {
+  const char* encodings[] = {"yuv422", "yuyv", "nv12", "nv21", "i420", "yv12"};
+  srand(0);
+  for (int e = 0; e < 6; e++)
+  {
+    YuvFormat format;
+    ASSERT_TRUE(yuvFormatFromEncoding(encodings[e], format));
+    for (int s = 0; s < 6; s++)
+    {
+      const int width = kSizes[s][0], height = kSizes[s][1];
+      const int step = (format.layout == YuvFormat::PACKED_422 ? 4 : 2) * ((width + 1) / 2) + 3;
+      ASSERT_EQ(0u, yuvImageSize(format, width, height, width / 2));
+      const Planes source(width, height, TH_PF_420, true);
+      const std::vector<unsigned char> image = makeYuvImage(format, source, width, height, step);
+
+      // To planes and back to the same layout is lossless, as the chroma of both rows of
+      // the packed image is the same
+      Planes planes(width, height, TH_PF_420, false);
+      yuvToYCbCr(&image[0], step, width, height, format, TH_PF_420, planes.buffer);
+      for (int c = 0; c < 3; c++)
+        for (int y = 0; y < height; y++)
+          for (int x = 0; x < width; x++)
+            ASSERT_EQ(source.sample(c, x, y, TH_PF_420), planes.sample(c, x, y, TH_PF_420))
+                << encodings[e] << " " << width << "x" << height << " plane " << c << " at " << x << "," << y;
+      if (format.layout != YuvFormat::PACKED_422)
+      {
+        std::vector<unsigned char> output(image.size());
+        yCbCrToYuv(planes.buffer, TH_PF_420, 0, 0, width, height, format, &output[0], step);
+        EXPECT_TRUE(std::equal(image.begin(), image.begin() + step * height, output.begin()));
+        // Only compare chroma samples, not the row padding
+        const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+        const int chroma_step = format.layout == YuvFormat::PLANAR_420 ? (step + 1) / 2 : step;
+        const int row_bytes = format.layout == YuvFormat::PLANAR_420 ? chroma_width : 2 * chroma_width;
+        const int chroma_rows = format.layout == YuvFormat::PLANAR_420 ? 2 * chroma_height : chroma_height;
+        for (int y = 0; y < chroma_rows; y++)
+        {
+          const size_t offset = step * height + y * chroma_step;
+          EXPECT_TRUE(std::equal(&image[offset], &image[offset] + row_bytes, &output[offset]))
+              << encodings[e] << " " << width << "x" << height << " chroma row " << y;
+        }
+      }
+
+      // 4:2:2 planes repeat each chroma row, and the result converts like the 4:2:0 planes
+      Planes planes422(width, height, TH_PF_422, false);
+      yuvToYCbCr(&image[0], step, width, height, format, TH_PF_422, planes422.buffer);
+      for (int c = 0; c < 3; c++)
+        for (int y = 0; y < height; y++)
+          for (int x = 0; x < width; x++)
+            ASSERT_EQ(source.sample(c, x, y, TH_PF_420), planes422.sample(c, x, y, TH_PF_422))
+                << encodings[e] << " " << width << "x" << height << " plane " << c << " at " << x << "," << y;
+
+      // And through the float reference to packed
+      PackedFormat bgr;
+      ASSERT_TRUE(packedFormatFromEncoding("bgr8", bgr));
+      std::vector<unsigned char> packed(3 * width * height);
+      yCbCrToPacked(planes.buffer, TH_PF_420, 0, 0, width, height, bgr, &packed[0], 3 * width);
+      for (int y = 0; y < height; y++)
+      {
+        for (int x = 0; x < width; x++)
+        {
+          double rgb[3];
+          refRgb(source.sample(0, x, y, TH_PF_420), source.sample(1, x, y, TH_PF_420),
+                 source.sample(2, x, y, TH_PF_420), rgb);
+          for (int k = 0; k < 3; k++)
+            EXPECT_NEAR(rgb[k], packed[3 * (y * width + x) + 2 - k], 1.0) << encodings[e] << " at " << x << "," << y;
+        }
+      }
+    }
+  }
+}
+
+TEST(ColorConversionTest, yuvPackedAveragesChromaRows) {
+  YuvFormat format;
+  ASSERT_TRUE(yuvFormatFromEncoding("uyvy", format));
+  srand(0);
+  const int width = 45, height = 31, step = 4 * 23;
+  const std::vector<unsigned char> image = randomImage(step, height);
+  Planes planes(width, height, TH_PF_420, false);
+  yuvToYCbCr(&image[0], step, width, height, format, TH_PF_420, planes.buffer);
+  for (int y = 0; y < height; y += 2)
+  {
+    for (int x = 0; x < width; x += 2)
+    {
+      const unsigned char* top = &image[y * step + 2 * x];
+      const unsigned char* bottom = y + 1 < height ? top + step : top;
+      EXPECT_EQ((top[0] + bottom[0] + 1) >> 1, planes.sample(1, x, y, TH_PF_420)) << x << "," << y;
+      EXPECT_EQ((top[2] + bottom[2] + 1) >> 1, planes.sample(2, x, y, TH_PF_420)) << x << "," << y;
+    }
+  }
+}
+
+TEST(ColorConversionTest, yCbCrToYuvAveragesChroma) {
+  YuvFormat format;
+  ASSERT_TRUE(yuvFormatFromEncoding("i420", format));
+  srand(0);
+  for (int s = 0; s < 6; s++)
+  {
+    const int width = kSizes[s][0], height = kSizes[s][1], step = width + 1;
+    const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2, chroma_step = (step + 1) / 2;
+    const th_pixel_fmt pixel_fmts[] = {TH_PF_422, TH_PF_444};
+    for (int f = 0; f < 2; f++)
+    {
+      const Planes planes(width, height, pixel_fmts[f], true);
+      std::vector<unsigned char> image(yuvImageSize(format, width, height, step));
+      yCbCrToYuv(planes.buffer, pixel_fmts[f], 0, 0, width, height, format, &image[0], step);
+      for (int c = 1; c < 3; c++)
+      {
+        const unsigned char* plane = &image[step * height + (c - 1) * chroma_step * chroma_height];
+        for (int y = 0; y < chroma_height; y++)
+        {
+          for (int x = 0; x < chroma_width; x++)
+          {
+            const int y1 = std::min(2 * y + 1, height - 1), x1 = std::min(2 * x + 1, width - 1);
+            const th_img_plane& p = planes.buffer[c];
+            int expected;
+            if (pixel_fmts[f] == TH_PF_422)
+              expected = (p.data[2 * y * p.stride + x] + p.data[y1 * p.stride + x] + 1) >> 1;
+            else
+              expected = (p.data[2 * y * p.stride + 2 * x] + p.data[2 * y * p.stride + x1] +
+                          p.data[y1 * p.stride + 2 * x] + p.data[y1 * p.stride + x1] + 2) >> 2;
+            EXPECT_EQ(expected, plane[y * chroma_step + x]) << width << "x" << height << " at " << x << "," << y;
+          }
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
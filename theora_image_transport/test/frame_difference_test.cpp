@@ -0,0 +1,177 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/frame_difference.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using theora_image_transport::blocksWithinLimit;
+
+// Two copies of a random plane with row padding
+struct PlanePair
+{
+  int width, height, step;
+  std::vector<unsigned char> a, b;
+
+  PlanePair(int width, int height) : width(width), height(height), step(width + 5)
+  {
+    a.resize(step * height);
+    for (size_t i = 0; i < a.size(); i++)
+      a[i] = rand();
+    b = a;
+  }
+
+  bool withinLimit(int block_width, int block_height, unsigned limit) const
+  {
+    return blocksWithinLimit(&a[0], step, &b[0], step, width, height, block_width, block_height, limit);
+  }
+
+  // Moves pixel (x, y) of b by diff away from a, in whichever direction fits
+  void change(int x, int y, int diff)
+  {
+    unsigned char& value = b[y * step + x];
+    value = value + diff <= 255 ? value + diff : value - diff;
+  }
+};
+
+// Straightforward reference
+static bool referenceWithinLimit(const PlanePair& p, int block_width, int block_height, unsigned limit)
+{
+  for (int y0 = 0; y0 < p.height; y0 += block_height)
+  {
+    for (int x0 = 0; x0 < p.width; x0 += block_width)
+    {
+      unsigned sum = 0;
+      for (int y = y0; y < std::min(y0 + block_height, p.height); y++)
+        for (int x = x0; x < std::min(x0 + block_width, p.width); x++)
+          sum += std::abs(p.a[y * p.step + x] - p.b[y * p.step + x]);
+      if (sum > limit)
+        return false;
+    }
+  }
+  return true;
+}
+
+TEST(FrameDifferenceTest, identicalPlanes) {
+  srand(0);
+  PlanePair p(64, 48);
+  EXPECT_TRUE(p.withinLimit(8, 8, 0));
+  EXPECT_TRUE(p.withinLimit(16, 16, 0));
+}
+
+TEST(FrameDifferenceTest, singlePixelOverLimit) {
+  srand(0);
+  const int block_widths[] = {8, 16};
+  for (int w = 0; w < 2; w++)
+  {
+    // Every position of a 16 pixel SIMD load and the tail after it
+    for (int x = 0; x < 40; x++)
+    {
+      PlanePair p(40, 20);
+      p.change(x, 13, 10);
+      EXPECT_TRUE(p.withinLimit(block_widths[w], 8, 10)) << x;
+      EXPECT_FALSE(p.withinLimit(block_widths[w], 8, 9)) << x;
+    }
+  }
+}
+
+TEST(FrameDifferenceTest, partialEdgeBlocks) {
+  srand(0);
+  const int block_widths[] = {8, 16};
+  for (int w = 0; w < 2; w++)
+  {
+    // 45 x 31 leaves a partial block column and row
+    PlanePair p(45, 31);
+    p.change(44, 30, 1);
+    EXPECT_TRUE(p.withinLimit(block_widths[w], 8, 1));
+    EXPECT_FALSE(p.withinLimit(block_widths[w], 8, 0));
+
+    // Pixels just outside the plane, in the row padding, are not compared
+    PlanePair q(45, 31);
+    for (int y = 0; y < q.height; y++)
+      q.b[y * q.step + q.width] ^= 0xff;
+    EXPECT_TRUE(q.withinLimit(block_widths[w], 8, 0));
+  }
+}
+
+TEST(FrameDifferenceTest, blockWidth) {
+  srand(0);
+  // Two differences in neighboring 8 pixel blocks fall into the same 16 pixel block
+  PlanePair p(64, 16);
+  p.change(3, 2, 6);
+  p.change(11, 5, 6);
+  EXPECT_TRUE(p.withinLimit(8, 8, 10));
+  EXPECT_FALSE(p.withinLimit(16, 8, 10));
+  EXPECT_TRUE(p.withinLimit(16, 8, 12));
+
+  // Rows of a block add up as well
+  PlanePair q(64, 16);
+  q.change(3, 1, 6);
+  q.change(3, 6, 6);
+  EXPECT_TRUE(q.withinLimit(8, 4, 6));
+  EXPECT_FALSE(q.withinLimit(8, 8, 11));
+}
+
+TEST(FrameDifferenceTest, matchesReference) {
+  srand(0);
+  const int sizes[][2] = {{1, 1}, {7, 3}, {16, 16}, {45, 31}, {67, 9}, {130, 17}};
+  const int block_widths[] = {8, 16};
+  for (int s = 0; s < 6; s++)
+  {
+    for (int i = 0; i < 20; i++)
+    {
+      PlanePair p(sizes[s][0], sizes[s][1]);
+      // A handful of small changes, so that results go both ways
+      for (int k = rand() % 6; k > 0; k--)
+        p.change(rand() % p.width, rand() % p.height, 1 + rand() % 20);
+      const unsigned limit = rand() % 40;
+      for (int w = 0; w < 2; w++)
+      {
+        const int block_height = 4 << (rand() % 3);
+        EXPECT_EQ(referenceWithinLimit(p, block_widths[w], block_height, limit),
+                  p.withinLimit(block_widths[w], block_height, limit))
+            << sizes[s][0] << "x" << sizes[s][1] << " block " << block_widths[w] << "x" << block_height
+            << " limit " << limit;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,174 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/keyframe_index.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+using theora_image_transport::KeyframeIndex;
+using theora_image_transport::KeyframeIndexEntry;
+using theora_image_transport::KeyframeIndexWriter;
+
+// Writes a dummy recording of the given size and an index of keyframes 1000 bytes and one
+// second apart, the last five in a second logical stream
+static std::string writeRecording(size_t size, int keyframes)
+{
+  char name[] = "/tmp/keyframe_index_test_XXXXXX";
+  int fd = mkstemp(name);
+  std::string data(size, 'x');
+  EXPECT_EQ((ssize_t)size, write(fd, data.data(), size));
+  close(fd);
+
+  KeyframeIndexWriter writer;
+  EXPECT_TRUE(writer.open(name));
+  for (int i = 0; i < keyframes; i++) {
+    KeyframeIndexEntry entry;
+    entry.offset = 100 + 1000 * i;
+    entry.header_offset = i < 5 ? 0 : 5000;
+    entry.granulepos = (ogg_int64_t)i << 6;
+    entry.stamp = ros::Time(10.0 + i);
+    entry.serial = i < 5 ? 0 : 1;
+    EXPECT_TRUE(writer.append(entry, 0));
+  }
+  return name;
+}
+
+static void removeRecording(const std::string& name)
+{
+  unlink(name.c_str());
+  unlink(theora_image_transport::keyframeIndexName(name).c_str());
+}
+
+TEST(KeyframeIndexTest, roundTrip) {
+  std::string name = writeRecording(10000, 10);
+  KeyframeIndex index;
+  ASSERT_TRUE(index.load(name));
+  ASSERT_EQ(10u, index.entries().size());
+  const KeyframeIndexEntry& entry = index.entries()[7];
+  EXPECT_EQ(7100u, entry.offset);
+  EXPECT_EQ(5000u, entry.header_offset);
+  EXPECT_EQ(7 << 6, entry.granulepos);
+  EXPECT_EQ(ros::Time(17.0).toNSec(), entry.stamp.toNSec());
+  EXPECT_EQ(1u, entry.serial);
+  removeRecording(name);
+}
+
+TEST(KeyframeIndexTest, findsPrecedingKeyframe) {
+  std::string name = writeRecording(10000, 10);
+  KeyframeIndex index;
+  ASSERT_TRUE(index.load(name));
+  EXPECT_EQ(100u, index.find(ros::Time(1.0))->offset);    // Before the recording
+  EXPECT_EQ(100u, index.find(ros::Time(10.0))->offset);   // Exactly on a keyframe
+  EXPECT_EQ(3100u, index.find(ros::Time(13.5))->offset);
+  EXPECT_EQ(9100u, index.find(ros::Time(100.0))->offset); // After the recording
+  removeRecording(name);
+}
+
+TEST(KeyframeIndexTest, findsKeyframeOfStream) {
+  std::string name = writeRecording(10000, 10);
+  KeyframeIndex index;
+  ASSERT_TRUE(index.load(name));
+  EXPECT_EQ(4100u, index.find(ros::Time(17.5), 0)->offset);
+  EXPECT_EQ(7100u, index.find(ros::Time(17.5), 1)->offset);
+  EXPECT_EQ(5100u, index.find(ros::Time(11.0), 1)->offset);
+  EXPECT_TRUE(index.find(ros::Time(11.0), 2) == NULL);
+  removeRecording(name);
+}
+
+TEST(KeyframeIndexTest, ignoresEntriesPastRecording) {
+  // Index entries of pages that were still queued when the recording stopped
+  std::string name = writeRecording(4500, 10);
+  KeyframeIndex index;
+  ASSERT_TRUE(index.load(name));
+  EXPECT_EQ(5u, index.entries().size());
+  removeRecording(name);
+}
+
+TEST(KeyframeIndexTest, skipsRepeatedKeyframes) {
+  std::string name = writeRecording(10000, 0);
+  KeyframeIndexWriter writer;
+  ASSERT_TRUE(writer.open(name));
+  KeyframeIndexEntry entry;
+  entry.offset = 100;
+  entry.header_offset = 0;
+  entry.granulepos = 0;
+  entry.stamp = ros::Time(10.0);
+  entry.serial = 0;
+  EXPECT_TRUE(writer.append(entry, 0));
+  // The same stamp in another track
+  entry.offset = 200;
+  entry.serial = 1;
+  EXPECT_TRUE(writer.append(entry, 1));
+  // A new link repeats the keyframe of track 0 under a new serial
+  entry.offset = 3000;
+  entry.header_offset = 2800;
+  entry.serial = 2;
+  EXPECT_FALSE(writer.append(entry, 0));
+  entry.offset = 4000;
+  entry.stamp = ros::Time(11.0);
+  EXPECT_TRUE(writer.append(entry, 0));
+  writer.close();
+
+  KeyframeIndex index;
+  ASSERT_TRUE(index.load(name));
+  ASSERT_EQ(3u, index.entries().size());
+  EXPECT_EQ(100u, index.entries()[0].offset);
+  EXPECT_EQ(200u, index.entries()[1].offset);
+  EXPECT_EQ(4000u, index.entries()[2].offset);
+
+  // The first link of a new file repeats it as well, and has to be indexed
+  ASSERT_TRUE(writer.open(name));
+  entry.offset = 100;
+  entry.header_offset = 0;
+  EXPECT_TRUE(writer.append(entry, 0));
+  writer.close();
+  ASSERT_TRUE(index.load(name));
+  ASSERT_EQ(1u, index.entries().size());
+  EXPECT_EQ(ros::Time(11.0).toNSec(), index.entries()[0].stamp.toNSec());
+  removeRecording(name);
+}
+
+TEST(KeyframeIndexTest, missingIndex) {
+  KeyframeIndex index;
+  EXPECT_FALSE(index.load("/tmp/keyframe_index_test_missing"));
+  EXPECT_TRUE(index.find(ros::Time(1.0)) == NULL);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,226 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2026, the image_transport_plugins contributors.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the copyright holder nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "theora_image_transport/ogg_writer.h"
+#include <gtest/gtest.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using theora_image_transport::OggWriter;
+
+// Smallest buffer OggWriter uses
+static const size_t kBufferSize = 1 << 16;
+
+// A page of the given size, split into header and body, filled with a pattern depending on seed
+struct Page
+{
+  std::vector<unsigned char> data;
+  ogg_page page;
+
+  Page(size_t size, int seed) : data(size)
+  {
+    for (size_t i = 0; i < size; i++)
+      data[i] = (unsigned char)(seed * 31 + i);
+    page.header = &data[0];
+    page.header_len = std::min<size_t>(27, size);
+    page.body = &data[0] + page.header_len;
+    page.body_len = size - page.header_len;
+  }
+};
+
+static std::string tempName(const char* suffix)
+{
+  char name[] = "/tmp/ogg_writer_test_XXXXXX";
+  int fd = mkstemp(name);
+  close(fd);
+  unlink(name);
+  return std::string(name) + suffix;
+}
+
+static std::string readFile(const std::string& name)
+{
+  std::string data;
+  FILE* file = fopen(name.c_str(), "rb");
+  if (!file)
+    return data;
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.append(buffer, n);
+  fclose(file);
+  return data;
+}
+
+static std::string pagesData(const std::vector<Page*>& pages)
+{
+  std::string data;
+  for (size_t i = 0; i < pages.size(); i++)
+    data.append(pages[i]->data.begin(), pages[i]->data.end());
+  return data;
+}
+
+TEST(OggWriterTest, writesOnDestruction) {
+  const std::string name = tempName(".ogv");
+  Page a(100, 1), b(5000, 2);
+  {
+    OggWriter writer(kBufferSize, 4, 0);
+    ASSERT_TRUE(writer.open(name));
+    writer.writePage(a.page);
+    writer.writePage(b.page);
+    EXPECT_EQ(5100u, writer.fileSize());
+  }
+  std::vector<Page*> pages;
+  pages.push_back(&a);
+  pages.push_back(&b);
+  EXPECT_EQ(pagesData(pages), readFile(name));
+  unlink(name.c_str());
+}
+
+TEST(OggWriterTest, rotatesFiles) {
+  // Each file spans several buffers and ends in a partly filled one
+  const std::string names[3] = {tempName("_0.ogv"), tempName("_1.ogv"), tempName("_2.ogv")};
+  std::vector<Page*> pages[3];
+  {
+    OggWriter writer(kBufferSize, 3, 1 << 20);
+    for (int f = 0; f < 3; f++)
+    {
+      ASSERT_TRUE(writer.open(names[f]));
+      EXPECT_EQ(0u, writer.fileSize());
+      for (int i = 0; i < 20 + 7 * f; i++)
+      {
+        pages[f].push_back(new Page(1000 + 997 * i, 100 * f + i));
+        writer.writePage(pages[f].back()->page);
+      }
+    }
+  }
+  for (int f = 0; f < 3; f++)
+  {
+    EXPECT_EQ(pagesData(pages[f]), readFile(names[f])) << names[f];
+    for (size_t i = 0; i < pages[f].size(); i++)
+      delete pages[f][i];
+    unlink(names[f].c_str());
+  }
+}
+
+TEST(OggWriterTest, failedOpenDiscardsPages) {
+  const std::string name = tempName(".ogv");
+  Page a(100, 1), b(200, 2);
+  {
+    OggWriter writer(kBufferSize, 2, 0);
+    ASSERT_TRUE(writer.open(name));
+    writer.writePage(a.page);
+    EXPECT_FALSE(writer.open("/nonexistent/ogg_writer_test.ogv"));
+    writer.writePage(b.page);
+    EXPECT_EQ(0u, writer.fileSize());
+  }
+  std::vector<Page*> pages(1, &a);
+  EXPECT_EQ(pagesData(pages), readFile(name));
+  unlink(name.c_str());
+}
+
+TEST(OggWriterTest, flushesOldBuffers) {
+  // A single small page has to reach the file without further writePage() or flush() calls
+  const std::string name = tempName(".ogv");
+  Page a(100, 1);
+  OggWriter writer(kBufferSize, 2, 0);
+  ASSERT_TRUE(writer.open(name));
+  writer.writePage(a.page);
+  for (int i = 0; i < 40 && readFile(name).size() < a.data.size(); i++)
+    usleep(100000);
+  std::vector<Page*> pages(1, &a);
+  EXPECT_EQ(pagesData(pages), readFile(name));
+  unlink(name.c_str());
+}
+
+static void writePages(OggWriter* writer, const std::vector<Page*>* pages)
+{
+  for (size_t i = 0; i < pages->size(); i++)
+    writer->writePage((*pages)[i]->page);
+}
+
+// Reads fd until end of file
+static void readAll(int fd, std::string* data)
+{
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    data->append(buffer, n);
+}
+
+TEST(OggWriterTest, blocksWhenAllBuffersAreQueued) {
+  // A FIFO nobody reads from yet stands in for a stalled disk
+  const std::string name = tempName(".fifo");
+  ASSERT_EQ(0, mkfifo(name.c_str(), 0600));
+  int reader = ::open(name.c_str(), O_RDONLY | O_NONBLOCK);
+  ASSERT_GE(reader, 0);
+  fcntl(reader, F_SETFL, 0);
+
+  // Far more than the FIFO, the buffer being written and the one being filled can take
+  std::vector<Page*> pages;
+  for (int i = 0; i < 40; i++)
+    pages.push_back(new Page(20000 + i, i));
+
+  OggWriter* writer = new OggWriter(kBufferSize, 2, 0);
+  ASSERT_TRUE(writer->open(name));
+  boost::thread producer(boost::bind(&writePages, writer, &pages));
+  EXPECT_FALSE(producer.timed_join(boost::posix_time::milliseconds(300)));
+  EXPECT_GE(writer->stalls(), 1u);
+
+  // Draining the FIFO lets writePage() continue. The writer closes the FIFO once it has written
+  // everything, on destruction.
+  std::string data;
+  boost::thread drain(boost::bind(&readAll, reader, &data));
+  producer.join();
+  delete writer;
+  drain.join();
+  EXPECT_EQ(pagesData(pages), data);
+
+  close(reader);
+  unlink(name.c_str());
+  for (size_t i = 0; i < pages.size(); i++)
+    delete pages[i];
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}